@@ -0,0 +1,258 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+#ifndef UTILS_COMPRESSEDSTATICVECTOR_H
+#define UTILS_COMPRESSEDSTATICVECTOR_H
+
+#include "staticvectoralgorithms.h"
+
+namespace Utils
+{
+	/**
+	 * \class CompressedStaticVector
+	 *
+	 * A compressed, immutable sibling of StaticVector<int>, for large series of values that vary only little (e.g. sensor counts).
+	 *
+	 * The values are stored in blocks of BlockSize values. Each block stores its smallest value, and the differences of all values to this reference value, bit-packed with as many bits as the largest difference needs. A block thus takes between 0 and 32 bits per value, plus 8 bytes for the block index. Random access with at() is O(1) and needs at most three memory reads; scans should decode whole blocks with decodeBlock() or decompress(), which are vectorized with SSE2.
+\code
+Utils::CompressedStaticVector history;
+history.compress(samples); //samples is a StaticVector<int>
+qDebug() << history.at(12345) << history.compressedBytes();
+\endcode
+	 * The data is held in StaticVectors, and follows their rules: A copy of a CompressedStaticVector is a read-only copy which shares the data. Calling compress() on any instance replaces the data of this instance only.
+	 */
+	class CompressedStaticVector
+	{
+		public:
+			enum { BlockSize = 128 };
+
+			///Creates an empty vector.
+			inline CompressedStaticVector();
+
+			///Replaces the data of this instance with a compressed copy of \a size values at \a values.
+			inline void compress(const int* values, int size);
+			///Replaces the data of this instance with a compressed copy of \a values.
+			inline void compress(const Utils::StaticVector<int>& values);
+			///Decompresses all values into \a target, which is resized to size() for that purpose.
+			inline void decompress(Utils::StaticVector<int>& target) const;
+
+			///Returns the number of values.
+			inline int size() const;
+			///Same as size().
+			inline int count() const;
+			///Returns the number of bytes occupied by the compressed data (including the block index).
+			inline int compressedBytes() const;
+
+			///Returns the value at index position \a i. If the index \a i is out of bounds, returns \a defaultValue instead.
+			inline int value(int i, int defaultValue = 0) const;
+			///Returns the value at index position \a i. \a i must be a valid index position (i.e., 0 <= \a i < size()).
+			inline int at(int i) const;
+
+			///Returns the number of blocks.
+			inline int blockCount() const;
+			///Decodes the values of the block with index \a block into \a target, which must have space for BlockSize values (even for the last block, which may contain less than BlockSize valid values).
+			inline void decodeBlock(int block, int* target) const;
+		private:
+			//The values of each block are distributed round-robin to four lanes, and each lane is bit-packed into consecutive words. The words of the four lanes are interleaved, so that one SSE2 register holds the same word of all lanes (i.e., four consecutive values can be decoded at once).
+			enum { LaneCount = 4, LaneSize = BlockSize / LaneCount };
+			static inline int bitsFor(quint32 range);
+			inline int blockBits(int block) const;
+
+			Utils::StaticVector<quint32> m_words;
+			Utils::StaticVector<int> m_references; //the smallest value of each block
+			Utils::StaticVector<int> m_offsets; //index of the first word of each block in m_words (with a sentinel, so the bit width of block k is (m_offsets[k + 1] - m_offsets[k]) / LaneCount)
+			int m_size;
+	};
+}
+
+Utils::CompressedStaticVector::CompressedStaticVector()
+	: m_size(0)
+{
+}
+
+int Utils::CompressedStaticVector::bitsFor(quint32 range)
+{
+	int bits = 0;
+	while (bits < 32 && (range >> bits) != 0)
+		++bits;
+	return bits;
+}
+
+int Utils::CompressedStaticVector::blockBits(int block) const
+{
+	const int* offsets = m_offsets.data();
+	return (offsets[block + 1] - offsets[block]) / LaneCount;
+}
+
+void Utils::CompressedStaticVector::compress(const int* values, int size)
+{
+	const int blockCount = (size + BlockSize - 1) / BlockSize;
+	m_size = size;
+	m_references.resize(blockCount);
+	m_offsets.resize(blockCount + 1);
+	int* references = m_references.data();
+	int* offsets = m_offsets.data();
+	//first pass: choose the reference value and the bit width of each block
+	offsets[0] = 0;
+	for (int block = 0; block < blockCount; ++block)
+	{
+		const int* blockValues = values + block * BlockSize;
+		const int blockSize = qMin(int(BlockSize), size - block * BlockSize);
+		const int minimum = Utils::StaticVectorKernels::minimum(blockValues, blockSize);
+		const int maximum = Utils::StaticVectorKernels::maximum(blockValues, blockSize);
+		references[block] = minimum;
+		offsets[block + 1] = offsets[block] + LaneCount * bitsFor(quint32(maximum) - quint32(minimum));
+	}
+	//second pass: pack the differences (the padding at the end of the last block is packed as zero)
+	m_words.resize(offsets[blockCount]);
+	quint32* words = m_words.data();
+	if (words)
+		memset(words, 0, offsets[blockCount] * sizeof(quint32));
+	for (int block = 0; block < blockCount; ++block)
+	{
+		const int bits = blockBits(block);
+		if (bits == 0)
+			continue;
+		const int* blockValues = values + block * BlockSize;
+		const int blockSize = qMin(int(BlockSize), size - block * BlockSize);
+		quint32* blockWords = words + offsets[block];
+		for (int i = 0; i < blockSize; ++i)
+		{
+			const quint32 difference = quint32(blockValues[i]) - quint32(references[block]);
+			const int bit = (i / LaneCount) * bits, lane = i % LaneCount;
+			const int word = bit / 32, shift = bit % 32;
+			blockWords[word * LaneCount + lane] |= difference << shift;
+			if (shift + bits > 32)
+				blockWords[(word + 1) * LaneCount + lane] |= difference >> (32 - shift);
+		}
+	}
+}
+
+void Utils::CompressedStaticVector::compress(const Utils::StaticVector<int>& values)
+{
+	compress(values.data(), values.size());
+}
+
+void Utils::CompressedStaticVector::decompress(Utils::StaticVector<int>& target) const
+{
+	target.resize(m_size);
+	int* targetData = target.data();
+	const int fullBlocks = m_size / BlockSize;
+	for (int block = 0; block < fullBlocks; ++block)
+		decodeBlock(block, targetData + block * BlockSize);
+	if (fullBlocks < blockCount())
+	{
+		int lastBlock[BlockSize];
+		decodeBlock(fullBlocks, lastBlock);
+		memcpy(targetData + fullBlocks * BlockSize, lastBlock, (m_size - fullBlocks * BlockSize) * sizeof(int));
+	}
+}
+
+int Utils::CompressedStaticVector::size() const
+{
+	return m_size;
+}
+
+int Utils::CompressedStaticVector::count() const
+{
+	return m_size;
+}
+
+int Utils::CompressedStaticVector::compressedBytes() const
+{
+	return m_words.size() * sizeof(quint32) + m_references.size() * sizeof(int) + m_offsets.size() * sizeof(int);
+}
+
+int Utils::CompressedStaticVector::value(int i, int defaultValue) const
+{
+	if (i < 0 || i >= m_size)
+		return defaultValue;
+	return at(i);
+}
+
+int Utils::CompressedStaticVector::at(int i) const
+{
+	Q_ASSERT(i >= 0 && i < m_size);
+	const int block = i / BlockSize, index = i % BlockSize;
+	const int reference = m_references.data()[block];
+	const int bits = blockBits(block);
+	if (bits == 0)
+		return reference;
+	const quint32* blockWords = m_words.data() + m_offsets.data()[block];
+	const int bit = (index / LaneCount) * bits, lane = index % LaneCount;
+	const int word = bit / 32, shift = bit % 32;
+	quint32 difference = blockWords[word * LaneCount + lane] >> shift;
+	if (shift + bits > 32)
+		difference |= blockWords[(word + 1) * LaneCount + lane] << (32 - shift);
+	if (bits < 32)
+		difference &= (quint32(1) << bits) - 1;
+	return int(quint32(reference) + difference);
+}
+
+int Utils::CompressedStaticVector::blockCount() const
+{
+	return m_references.size();
+}
+
+void Utils::CompressedStaticVector::decodeBlock(int block, int* target) const
+{
+	Q_ASSERT(block >= 0 && block < blockCount());
+	const int reference = m_references.data()[block];
+	const int bits = blockBits(block);
+	if (bits == 0)
+	{
+		Utils::StaticVectorKernels::fill(target, BlockSize, reference);
+		return;
+	}
+	const quint32* blockWords = m_words.data() + m_offsets.data()[block];
+	const quint32 mask = bits < 32 ? (quint32(1) << bits) - 1 : ~quint32(0);
+#ifdef UTILS_STATICVECTOR_SSE2
+	const __m128i* vectors = reinterpret_cast<const __m128i*>(blockWords);
+	const __m128i maskVector = _mm_set1_epi32(mask);
+	const __m128i referenceVector = _mm_set1_epi32(reference);
+	for (int position = 0; position < LaneSize; ++position)
+	{
+		const int bit = position * bits;
+		const int word = bit / 32, shift = bit % 32;
+		__m128i differences = _mm_srl_epi32(_mm_loadu_si128(vectors + word), _mm_cvtsi32_si128(shift));
+		if (shift + bits > 32)
+			differences = _mm_or_si128(differences, _mm_sll_epi32(_mm_loadu_si128(vectors + word + 1), _mm_cvtsi32_si128(32 - shift)));
+		differences = _mm_and_si128(differences, maskVector);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(target + position * LaneCount), _mm_add_epi32(differences, referenceVector));
+	}
+#else
+	for (int position = 0; position < LaneSize; ++position)
+	{
+		const int bit = position * bits;
+		const int word = bit / 32, shift = bit % 32;
+		for (int lane = 0; lane < LaneCount; ++lane)
+		{
+			quint32 difference = blockWords[word * LaneCount + lane] >> shift;
+			if (shift + bits > 32)
+				difference |= blockWords[(word + 1) * LaneCount + lane] << (32 - shift);
+			target[position * LaneCount + lane] = int(quint32(reference) + (difference & mask));
+		}
+	}
+#endif
+}
+
+#endif //UTILS_COMPRESSEDSTATICVECTOR_H
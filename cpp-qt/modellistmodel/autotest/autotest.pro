@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = modellistmodelautotest
+CONFIG += console
+CONFIG -= app_bundle
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent testlib
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+
+# Input
+HEADERS += ../modellistmodel.h
+SOURCES += ../modellistmodel.cpp testing.cpp
@@ -0,0 +1,158 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+//Non-interactive tests for Utils::ModelListModel (see ../testing.cpp for the interactive demo). Each failed check prints a message; the program prints PASS or FAIL at the end.
+
+#include "modellistmodel.h"
+
+#include <QCoreApplication>
+#include <QStringListModel>
+#include <cstdio>
+#if QT_VERSION >= 0x050B00
+#include <QAbstractItemModelTester>
+#endif
+
+static int check(bool condition, const char* description)
+{
+	if (condition)
+		return 0;
+	fprintf(stderr, "failed: %s\n", description);
+	return 1;
+}
+
+static QStringList rootTexts(const Utils::ModelListModel& model, const QModelIndex& parent)
+{
+	QStringList texts;
+	for (int row = 0; row < model.rowCount(parent); ++row)
+		texts << model.data(model.index(row, 0, parent)).toString();
+	return texts;
+}
+
+//BEGIN data cache
+
+static int testDataCache()
+{
+	int errors = 0;
+	Utils::ModelListModel model;
+	QStringListModel* subModel = new QStringListModel(QStringList() << "a" << "b" << "c");
+	model.addSubModel("strings", subModel);
+	model.setDataCacheSize(100);
+	const QModelIndex parent = model.index(0, 0);
+	//the first reads miss, the second reads hit
+	errors += check(rootTexts(model, parent) == (QStringList() << "a" << "b" << "c"), "data cache: values of the first reads");
+	errors += check(model.dataCacheHits() == 0 && model.dataCacheMisses() == 3, "data cache: counters after the first reads");
+	errors += check(rootTexts(model, parent) == (QStringList() << "a" << "b" << "c"), "data cache: values of the second reads");
+	errors += check(model.dataCacheHits() == 3 && model.dataCacheMisses() == 3, "data cache: counters after the second reads");
+	//dataChanged() invalidates only the changed row
+	subModel->setData(subModel->index(1), "B");
+	errors += check(rootTexts(model, parent) == (QStringList() << "a" << "B" << "c"), "data cache: values after dataChanged");
+	errors += check(model.dataCacheHits() == 5 && model.dataCacheMisses() == 4, "data cache: counters after dataChanged");
+	//inserted rows invalidate the rows behind them, which have moved
+	subModel->insertRows(1, 1);
+	subModel->setData(subModel->index(1), "x");
+	errors += check(rootTexts(model, parent) == (QStringList() << "a" << "x" << "B" << "c"), "data cache: values after the insertion");
+	errors += check(model.dataCacheHits() == 6 && model.dataCacheMisses() == 7, "data cache: counters after the insertion");
+	//so do removed rows
+	subModel->removeRows(0, 1);
+	errors += check(rootTexts(model, parent) == (QStringList() << "x" << "B" << "c"), "data cache: values after the removal");
+	errors += check(model.dataCacheHits() == 6 && model.dataCacheMisses() == 10, "data cache: counters after the removal");
+	//rows that are appended do not affect the existing rows
+	subModel->insertRows(3, 1);
+	subModel->setData(subModel->index(3), "y");
+	errors += check(rootTexts(model, parent) == (QStringList() << "x" << "B" << "c" << "y"), "data cache: values after appending");
+	errors += check(model.dataCacheHits() == 9 && model.dataCacheMisses() == 11, "data cache: counters after appending");
+	//a disabled cache is not consulted
+	model.setDataCacheSize(0);
+	errors += check(rootTexts(model, parent) == (QStringList() << "x" << "B" << "c" << "y"), "data cache: values without cache");
+	errors += check(model.dataCacheHits() == 9 && model.dataCacheMisses() == 11, "data cache: counters without cache");
+	return errors;
+}
+
+//END data cache
+
+//BEGIN persistent indexes
+
+#if QT_VERSION >= 0x050B00
+static int warningCount = 0;
+
+static void countWarnings(QtMsgType type, const QMessageLogContext& context, const QString& message)
+{
+	Q_UNUSED(context)
+	if (type == QtDebugMsg || type == QtInfoMsg)
+		return;
+	++warningCount;
+	fprintf(stderr, "%s\n", qPrintable(message));
+}
+#endif
+
+static int testPersistentIndexes()
+{
+	int errors = 0;
+	Utils::ModelListModel model;
+	QStringListModel* first = new QStringListModel(QStringList() << "c" << "a" << "b");
+	QStringListModel* second = new QStringListModel(QStringList() << "z" << "y");
+	model.addSubModel("first", first);
+	model.addSubModel("second", second);
+#if QT_VERSION >= 0x050B00
+	//the tester checks the consistency of the model after each signal (in particular, that its own persistent indexes are moved correctly)
+	QtMessageHandler previousHandler = qInstallMessageHandler(countWarnings);
+	QAbstractItemModelTester tester(&model, QAbstractItemModelTester::FailureReportingMode::Warning);
+#endif
+	const QPersistentModelIndex a = model.index(1, 0, model.index(0, 0));
+	const QPersistentModelIndex y = model.index(1, 0, model.index(1, 0));
+	//a layout change of a submodel moves its persistent indexes with their rows
+	first->sort(0);
+	errors += check(rootTexts(model, model.index(0, 0)) == (QStringList() << "a" << "b" << "c"), "persistent indexes: rows after the layout change");
+	errors += check(a.isValid() && a.row() == 0 && a.data().toString() == "a", "persistent indexes: moved by the layout change");
+	errors += check(y.isValid() && y.row() == 1 && y.data().toString() == "y", "persistent indexes: other submodel after the layout change");
+	//a reset of a submodel removes its persistent indexes, but keeps those of the other submodels
+	first->setStringList(QStringList() << "d");
+	errors += check(rootTexts(model, model.index(0, 0)) == (QStringList() << "d"), "persistent indexes: rows after the reset");
+	errors += check(!a.isValid(), "persistent indexes: removed by the reset");
+	errors += check(y.isValid() && y.row() == 1 && y.data().toString() == "y", "persistent indexes: other submodel after the reset");
+	//in sorted flat mode, a layout change moves the root-level rows of the other submodels, too (here: b, d, y, z)
+	model.setFlat(true);
+	model.sort(0);
+	second->setStringList(QStringList() << "z" << "b" << "y");
+	const QPersistentModelIndex d = model.index(1, 0);
+	const QPersistentModelIndex z = model.index(3, 0);
+	second->sort(0, Qt::DescendingOrder);
+	errors += check(rootTexts(model, QModelIndex()) == (QStringList() << "b" << "d" << "y" << "z"), "persistent indexes: merged rows after the layout change");
+	errors += check(d.isValid() && d.row() == 1 && d.data().toString() == "d", "persistent indexes: other submodel after the merged layout change");
+	errors += check(z.isValid() && z.row() == 3 && z.data().toString() == "z", "persistent indexes: moved by the merged layout change");
+#if QT_VERSION >= 0x050B00
+	qInstallMessageHandler(previousHandler);
+	errors += check(warningCount == 0, "persistent indexes: no complaints by QAbstractItemModelTester");
+#endif
+	return errors;
+}
+
+//END persistent indexes
+
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	int errors = testDataCache();
+	errors += testPersistentIndexes();
+	printf(errors ? "FAIL\n" : "PASS\n");
+	return errors ? 1 : 0;
+}
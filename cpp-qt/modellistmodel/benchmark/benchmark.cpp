@@ -0,0 +1,286 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+//Benchmarks for Utils::ModelListModel. Each benchmark prints the time per operation. Pass the names of benchmarks as arguments to run only these (e.g. "modellistmodelbench lookup").
+
+#include "modellistmodel.h"
+
+#include <QAbstractListModel>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <cstdio>
+#include <cstring>
+
+static volatile qint64 sink; //keeps the compiler from optimizing the measured loops away
+
+static void report(const char* name, const QElapsedTimer& timer, qint64 operations)
+{
+	printf("  %-48s %10.2f ns/op\n", name, double(timer.nsecsElapsed()) / operations);
+}
+
+//A list model with one integer per row, which is cheap enough that the benchmarks measure the ModelListModel instead of the submodels.
+class IntegerModel : public QAbstractListModel
+{
+	public:
+		IntegerModel(const QVector<int>& values) : m_values(values) {}
+		virtual int rowCount(const QModelIndex& parent = QModelIndex()) const
+		{
+			return parent.isValid() ? 0 : m_values.count();
+		}
+		virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const
+		{
+			if (!index.isValid() || role != Qt::DisplayRole)
+				return QVariant();
+			return m_values[index.row()];
+		}
+		void insertValues(int row, const QVector<int>& values)
+		{
+			beginInsertRows(QModelIndex(), row, row + values.count() - 1);
+			m_values.insert(row, values.count(), 0);
+			for (int i = 0; i < values.count(); ++i)
+				m_values[row + i] = values[i];
+			endInsertRows();
+		}
+		void removeValues(int row, int count)
+		{
+			beginRemoveRows(QModelIndex(), row, row + count - 1);
+			m_values.remove(row, count);
+			endRemoveRows();
+		}
+		void setValues(int row, const QVector<int>& values)
+		{
+			for (int i = 0; i < values.count(); ++i)
+				m_values[row + i] = values[i];
+			emit dataChanged(index(row), index(row + values.count() - 1));
+		}
+	private:
+		QVector<int> m_values;
+};
+
+static quint32 randomNumber(quint32& state) //xorshift, so that all runs use the same rows
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static QVector<int> sequence(int count, int first = 0)
+{
+	QVector<int> values(count);
+	for (int i = 0; i < count; ++i)
+		values[i] = first + i;
+	return values;
+}
+
+//BEGIN lookup
+
+static void benchmarkLookup()
+{
+	enum { SubModelCount = 1000, RowCount = 100, Rounds = 20, LookupCount = 1 << 20 };
+	printf("lookup (tree mode with %d submodels):\n", int(SubModelCount));
+	Utils::ModelListModel model;
+	QList<QAbstractItemModel*> subModels;
+	for (int i = 0; i < SubModelCount; ++i)
+	{
+		IntegerModel* subModel = new IntegerModel(sequence(RowCount));
+		subModels << subModel;
+		model.addSubModel(QString::number(i), subModel);
+	}
+	QElapsedTimer timer;
+	//what a view does for each row while scrolling over all submodels: every call maps the index to its submodel
+	qint64 sum = 0;
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < SubModelCount; ++i)
+		{
+			const QModelIndex parent = model.index(i, 0);
+			for (int row = 0; row < RowCount; ++row)
+			{
+				const QModelIndex index = model.index(row, 0, parent);
+				sum += model.data(index).toInt() + int(model.flags(index)) + model.rowCount(index) + model.parent(index).row();
+			}
+		}
+	report("index(), data(), flags(), rowCount(), parent()", timer, qint64(Rounds) * SubModelCount * RowCount);
+	//the submodel lookup on its own: the linear scan of the submodel list before, and the hash lookup now
+	timer.start();
+	for (int i = 0; i < LookupCount; ++i)
+		sum += subModels.indexOf(subModels[(i * 7919) % SubModelCount]);
+	report("submodel row by QList::indexOf (before)", timer, LookupCount);
+	QHash<QAbstractItemModel*, int> subModelRows;
+	for (int i = 0; i < SubModelCount; ++i)
+		subModelRows.insert(subModels[i], i);
+	timer.start();
+	for (int i = 0; i < LookupCount; ++i)
+		sum += subModelRows.value(subModels[(i * 7919) % SubModelCount]);
+	report("submodel row by QHash::value (now)", timer, LookupCount);
+	sink += sum;
+}
+
+//END lookup
+
+//BEGIN flat
+
+static void benchmarkFlat()
+{
+	enum { SubModelCount = 200, RowCount = 50000, AccessCount = 1 << 20, InsertCount = 10000 };
+	printf("flat (flat mode with %d submodels of %d rows):\n", int(SubModelCount), int(RowCount));
+	Utils::ModelListModel model;
+	model.setFlat(true);
+	QList<IntegerModel*> subModels;
+	for (int i = 0; i < SubModelCount; ++i)
+	{
+		IntegerModel* subModel = new IntegerModel(sequence(RowCount, i * RowCount));
+		subModels << subModel;
+		model.addSubModel(QString::number(i), subModel);
+	}
+	quint32 state = 0x2545F491;
+	QElapsedTimer timer;
+	//random access: finding the submodel of a row is a descent in the prefix sums
+	const int totalRowCount = model.rowCount();
+	qint64 sum = 0;
+	timer.start();
+	for (int i = 0; i < AccessCount; ++i)
+		sum += model.data(model.index(randomNumber(state) % totalRowCount, 0)).toInt();
+	report("index() and data() of random rows", timer, AccessCount);
+	//insertion into the middle submodel: only the prefix sums above it change
+	IntegerModel* middle = subModels[SubModelCount / 2];
+	const QVector<int> value(1, -1);
+	timer.start();
+	for (int i = 0; i < InsertCount; ++i)
+		middle->insertValues(randomNumber(state) % (middle->rowCount() + 1), value);
+	report("insertion of one row into the middle submodel", timer, InsertCount);
+	sink += sum + model.rowCount();
+}
+
+//END flat
+
+//BEGIN search
+
+static void benchmarkSearch()
+{
+	enum { SubModelCount = 100, RowCount = 10000, QueryCount = 1000 };
+	printf("search (%d submodels of %d rows):\n", int(SubModelCount), int(RowCount));
+	Utils::ModelListModel model;
+	for (int i = 0; i < SubModelCount; ++i)
+		model.addSubModel(QString::number(i), new IntegerModel(sequence(RowCount, i * RowCount)));
+	QElapsedTimer timer;
+	//the texts are read in the GUI thread, which blocks the event loop
+	timer.start();
+	model.setSearchRole(Qt::DisplayRole);
+	report("setSearchRole() (reading the texts, per row)", timer, qint64(SubModelCount) * RowCount);
+	//the postings are built in the background
+	QThreadPool::globalInstance()->waitForDone();
+	QCoreApplication::processEvents(); //delivers the results
+	report("until the index is built (per row)", timer, qint64(SubModelCount) * RowCount);
+	qint64 sum = 0;
+	quint32 state = 0x2545F491;
+	timer.start();
+	for (int i = 0; i < QueryCount; ++i)
+		sum += model.findRows(QString::number(randomNumber(state) % (SubModelCount * RowCount))).count();
+	report("findRows() over all submodels", timer, QueryCount);
+	sink += sum;
+}
+
+//END search
+
+//BEGIN merged
+
+static void benchmarkMerged()
+{
+	enum { SubModelCount = 200, RowCount = 25000, InsertCount = 100, BatchSize = 10000 };
+	printf("merged (sorted flat mode with %d submodels of %d rows):\n", int(SubModelCount), int(RowCount));
+	Utils::ModelListModel model;
+	model.setFlat(true);
+	QList<IntegerModel*> subModels;
+	for (int i = 0; i < SubModelCount; ++i)
+	{
+		//the rows of all submodels are interleaved in the sorted order
+		QVector<int> values(RowCount);
+		for (int row = 0; row < RowCount; ++row)
+			values[row] = row * SubModelCount + i;
+		IntegerModel* subModel = new IntegerModel(values);
+		subModels << subModel;
+		model.addSubModel(QString::number(i), subModel);
+	}
+	const int totalRowCount = model.rowCount();
+	quint32 state = 0x2545F491;
+	QElapsedTimer timer;
+	timer.start();
+	model.sort(0);
+	report("sort() (per row)", timer, totalRowCount);
+	//single rows: each one is moved to its place in the merged order
+	IntegerModel* middle = subModels[SubModelCount / 2];
+	timer.start();
+	for (int i = 0; i < InsertCount; ++i)
+		middle->insertValues(middle->rowCount(), QVector<int>(1, randomNumber(state) % totalRowCount));
+	report("insertion of one row with a random key", timer, InsertCount);
+	//a batch with one key: one contiguous range
+	timer.start();
+	middle->insertValues(middle->rowCount(), QVector<int>(BatchSize, totalRowCount / 2));
+	report("insertion of a batch with one key (per row)", timer, BatchSize);
+	//a sorted batch of scattered keys: an insertion at the end, and a layout change
+	QVector<int> values(BatchSize);
+	for (int i = 0; i < BatchSize; ++i)
+		values[i] = int(qint64(i) * totalRowCount / BatchSize);
+	timer.start();
+	middle->insertValues(middle->rowCount(), values);
+	report("insertion of a sorted batch of scattered keys (per row)", timer, BatchSize);
+	//the same batch is changed and removed again
+	for (int i = 0; i < BatchSize; ++i)
+		values[i] = randomNumber(state) % totalRowCount;
+	const int first = middle->rowCount() - BatchSize;
+	timer.start();
+	middle->setValues(first, values);
+	report("change of a batch to scattered keys (per row)", timer, BatchSize);
+	timer.start();
+	middle->removeValues(first, BatchSize);
+	report("removal of a batch of scattered rows (per row)", timer, BatchSize);
+	sink += model.rowCount() + model.index(totalRowCount / 2, 0).data().toInt();
+}
+
+//END merged
+
+static bool isSelected(int argc, char** argv, const char* name)
+{
+	if (argc < 2)
+		return true;
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], name) == 0)
+			return true;
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	if (isSelected(argc, argv, "lookup"))
+		benchmarkLookup();
+	if (isSelected(argc, argv, "flat"))
+		benchmarkFlat();
+	if (isSelected(argc, argv, "search"))
+		benchmarkSearch();
+	if (isSelected(argc, argv, "merged"))
+		benchmarkMerged();
+	return 0;
+}
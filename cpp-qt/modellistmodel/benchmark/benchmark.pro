@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = modellistmodelbench
+CONFIG += console release
+CONFIG -= app_bundle
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+
+# Input
+HEADERS += ../modellistmodel.h
+SOURCES += ../modellistmodel.cpp benchmark.cpp
@@ -22,81 +22,147 @@
 
 #include "modellistmodel.h"
 
+#include <algorithm>
 #include <climits>
+#include <QFutureWatcher>
+#include <QDateTime>
+#include <QMultiHash>
+#include <qnumeric.h>
 #include <QStandardItemModel>
+#include <QtAlgorithms>
+#include <QtConcurrentRun>
 
 Utils::ModelListModel::ModelListModel(QObject* parent)
 	: QAbstractItemModel(parent)
 	, m_metaModel(new QStandardItemModel)
 	, m_headerDataSubModel(0)
+	, m_flushScheduled(false)
+	, m_flat(false)
+	, m_flatColumnCount(0)
+	, m_sortColumn(-1)
+	, m_sortOrder(Qt::AscendingOrder)
+	, m_sortRole(Qt::DisplayRole)
+	, m_dataCache(0)
+	, m_dataCacheHits(0)
+	, m_dataCacheMisses(0)
+	, m_searchRole(-1)
 {
+	allocateNode(m_metaModel, QModelIndex(), true); //this is MetaNode
 }
 
 Utils::ModelListModel::~ModelListModel()
 {
+	qDeleteAll(m_searchIndexes); //running builds are not waited for, their results are discarded
 	delete m_metaModel;
 	//submodels are automatically deleted because of QObject::setParent
 }
 
-void Utils::ModelListModel::addSubModel(const QString& caption, QAbstractListModel* subModel)
+void Utils::ModelListModel::addSubModel(const QString& caption, QAbstractItemModel* subModel)
 {
-	if (!m_subModels.contains(subModel)) //avoid memleak in QStandardItem construction
+	if (!m_subModelRows.contains(subModel)) //avoid memleak in QStandardItem construction
 		addSubModelInternal(new QStandardItem(caption), subModel);
 }
 
-void Utils::ModelListModel::addSubModel(const QString& caption, QAbstractTableModel* subModel)
-{
-	if (!m_subModels.contains(subModel)) //avoid memleak in QStandardItem construction
-		addSubModelInternal(new QStandardItem(caption), subModel);
-}
-
-void Utils::ModelListModel::addSubModel(QStandardItem* metaItem, QAbstractListModel* subModel)
-{
-	addSubModelInternal(metaItem, subModel);
-}
-
-void Utils::ModelListModel::addSubModel(QStandardItem* metaItem, QAbstractTableModel* subModel)
+void Utils::ModelListModel::addSubModel(QStandardItem* metaItem, QAbstractItemModel* subModel)
 {
 	addSubModelInternal(metaItem, subModel);
 }
 
 void Utils::ModelListModel::addSubModelInternal(QStandardItem* metaItem, QAbstractItemModel* subModel)
 {
-	if (m_subModels.contains(subModel))
+	if (m_subModelRows.contains(subModel))
 		return;
 	const int newRow = m_subModels.count();
-	beginInsertRows(QModelIndex(), newRow, newRow);
+	const int subModelRowCount = subModel->rowCount();
+	//in flat mode, the rows of the submodel appear at the end of the root level (and nothing appears if it is empty); in sorted flat mode, they are scattered, so the model is reset
+	const bool merged = isMerged();
+	const int firstRow = m_flat ? m_rowOffsets.total() : newRow;
+	const int lastRow = m_flat ? firstRow + subModelRowCount - 1 : newRow;
+	if (merged)
+		beginResetModel();
+	else if (lastRow >= firstRow)
+		beginInsertRows(QModelIndex(), firstRow, lastRow);
 	metaItem->setEditable(false);
 	m_metaModel->appendRow(metaItem);
 	m_subModels << subModel;
+	m_subModelRows.insert(subModel, newRow);
+	m_rowOffsets.append(subModelRowCount);
+	m_rootNodes.insert(subModel, allocateNode(subModel, QModelIndex(), true));
 	subModel->QObject::setParent(this);
-	endInsertRows();
+	if (merged)
+	{
+		m_flatColumnCount = subModelColumnCount();
+		rebuildMergedOrder();
+		endResetModel();
+	}
+	else
+	{
+		if (lastRow >= firstRow)
+			endInsertRows();
+		updateFlatColumnCount(); //the new submodel may have more columns than the others
+	}
+	if (m_searchRole != -1)
+		buildSearchIndex(subModel, true);
 	//connect signals
 	connect(subModel, SIGNAL(columnsAboutToBeInserted(const QModelIndex&, int, int)), this, SLOT(handleColumnsAboutToBeInserted(const QModelIndex&, int, int)));
+	connect(subModel, SIGNAL(columnsAboutToBeMoved(const QModelIndex&, int, int, const QModelIndex&, int)), this, SLOT(handleColumnsAboutToBeMoved(const QModelIndex&, int, int, const QModelIndex&, int)));
 	connect(subModel, SIGNAL(columnsAboutToBeRemoved(const QModelIndex&, int, int)), this, SLOT(handleColumnsAboutToBeRemoved(const QModelIndex&, int, int)));
-	connect(subModel, SIGNAL(columnsInserted(const QModelIndex&, int, int)), this, SLOT(handleColumnsInserted()));
-	connect(subModel, SIGNAL(columnsRemoved(const QModelIndex&, int, int)), this, SLOT(handleColumnsRemoved()));
+	connect(subModel, SIGNAL(columnsInserted(const QModelIndex&, int, int)), this, SLOT(handleColumnsInserted(const QModelIndex&, int, int)));
+	connect(subModel, SIGNAL(columnsMoved(const QModelIndex&, int, int, const QModelIndex&, int)), this, SLOT(handleColumnsMoved(const QModelIndex&, int, int, const QModelIndex&, int)));
+	connect(subModel, SIGNAL(columnsRemoved(const QModelIndex&, int, int)), this, SLOT(handleColumnsRemoved(const QModelIndex&, int, int)));
 	connect(subModel, SIGNAL(dataChanged(const QModelIndex&, const QModelIndex&)), this, SLOT(handleDataChanged(const QModelIndex&, const QModelIndex&)));
 	connect(subModel, SIGNAL(headerDataChanged(Qt::Orientation, int, int)), this, SLOT(handleHeaderDataChanged(Qt::Orientation, int, int)));
+	connect(subModel, SIGNAL(layoutAboutToBeChanged()), this, SLOT(handleLayoutAboutToBeChanged()));
+	connect(subModel, SIGNAL(layoutChanged()), this, SLOT(handleLayoutChanged()));
+	connect(subModel, SIGNAL(modelAboutToBeReset()), this, SLOT(handleModelAboutToBeReset()));
+	connect(subModel, SIGNAL(modelReset()), this, SLOT(handleModelReset()));
 	connect(subModel, SIGNAL(rowsAboutToBeInserted(const QModelIndex&, int, int)), this, SLOT(handleRowsAboutToBeInserted(const QModelIndex&, int, int)));
+	connect(subModel, SIGNAL(rowsAboutToBeMoved(const QModelIndex&, int, int, const QModelIndex&, int)), this, SLOT(handleRowsAboutToBeMoved(const QModelIndex&, int, int, const QModelIndex&, int)));
 	connect(subModel, SIGNAL(rowsAboutToBeRemoved(const QModelIndex&, int, int)), this, SLOT(handleRowsAboutToBeRemoved(const QModelIndex&, int, int)));
-	connect(subModel, SIGNAL(rowsInserted(const QModelIndex&, int, int)), this, SLOT(handleRowsInserted()));
-	connect(subModel, SIGNAL(rowsRemoved(const QModelIndex&, int, int)), this, SLOT(handleRowsRemoved()));
+	connect(subModel, SIGNAL(rowsInserted(const QModelIndex&, int, int)), this, SLOT(handleRowsInserted(const QModelIndex&, int, int)));
+	connect(subModel, SIGNAL(rowsMoved(const QModelIndex&, int, int, const QModelIndex&, int)), this, SLOT(handleRowsMoved(const QModelIndex&, int, int, const QModelIndex&, int)));
+	connect(subModel, SIGNAL(rowsRemoved(const QModelIndex&, int, int)), this, SLOT(handleRowsRemoved(const QModelIndex&, int, int)));
 	connect(subModel, SIGNAL(destroyed(QObject*)), this, SLOT(handleSubModelDeleted(QObject*)));
 }
 
 void Utils::ModelListModel::removeSubModel(QAbstractItemModel* subModel)
 {
 	//NOTE: This may not call any methods of the model, because this method is called by Utils::ModelListModel::handleSubModelDeleted, which is invoked by the submodel's QObject::destroyed signal.
-	const int index = m_subModels.indexOf(subModel);
+	const int index = m_subModelRows.value(subModel, -1);
 	if (index == -1)
 		return;
-	beginRemoveRows(QModelIndex(), index, index);
+	m_pendingDataChanges.remove(subModel); //cannot be flushed here (see above)
+	delete m_searchIndexes.take(subModel);
+	m_searchBuilds.remove(subModel); //the result of a running build will be discarded
+	m_resettingSubModels.remove(subModel);
+	const bool merged = isMerged();
+	const int firstRow = m_flat ? m_rowOffsets.offset(index) : index;
+	const int lastRow = m_flat ? firstRow + m_rowOffsets.count(index) - 1 : index;
+	if (merged)
+		beginResetModel(); //see addSubModelInternal
+	else if (lastRow >= firstRow)
+		beginRemoveRows(QModelIndex(), firstRow, lastRow);
 	m_metaModel->removeRow(index);
 	m_subModels.removeAt(index);
+	m_subModelRows.remove(subModel);
+	for (int row = index; row < m_subModels.count(); ++row)
+		m_subModelRows[m_subModels[row]] = row;
+	m_rowOffsets.removeAt(index);
+	freeNodeTree(m_rootNodes.take(subModel));
 	if (subModel->QObject::parent() == this)
 		subModel->QObject::setParent(0);
-	endRemoveRows();
+	if (merged)
+	{
+		m_flatColumnCount = subModelColumnCount(); //reads only the remaining submodels, too
+		rebuildMergedOrder(); //reads only the remaining submodels
+		endResetModel();
+	}
+	else
+	{
+		if (lastRow >= firstRow)
+			endRemoveRows();
+		updateFlatColumnCount(); //the removed submodel may have had more columns than the others
+	}
 	disconnect(subModel, 0, this, 0);
 	if (m_headerDataSubModel == subModel)
 		setHeaderDataSubModel(0);
@@ -104,7 +170,7 @@ void Utils::ModelListModel::removeSubModel(QAbstractItemModel* subModel)
 
 void Utils::ModelListModel::setHeaderDataSubModel(QAbstractItemModel* subModel)
 {
-	if (!subModel || !m_subModels.contains(subModel)) //except for model == 0, allow only submodels that have been added to this model
+	if (!subModel || !m_subModelRows.contains(subModel)) //except for model == 0, allow only submodels that have been added to this model
 		return;
 	if (m_headerDataSubModel != subModel)
 	{
@@ -115,6 +181,104 @@ void Utils::ModelListModel::setHeaderDataSubModel(QAbstractItemModel* subModel)
 	}
 }
 
+bool Utils::ModelListModel::isFlat() const
+{
+	return m_flat;
+}
+
+void Utils::ModelListModel::setFlat(bool flat)
+{
+	if (m_flat == flat)
+		return;
+	beginResetModel();
+	m_pendingDataChanges.clear(); //the views will query all data anyway
+	m_flat = flat;
+	m_flatColumnCount = subModelColumnCount();
+	rebuildMergedOrder();
+	endResetModel();
+}
+
+int Utils::ModelListModel::dataCacheSize() const
+{
+	return m_dataCache.maxCost();
+}
+
+void Utils::ModelListModel::setDataCacheSize(int size)
+{
+	m_dataCache.setMaxCost(qMax(size, 0)); //drops the least recently used values if the cache shrinks
+}
+
+quint64 Utils::ModelListModel::dataCacheHits() const
+{
+	return m_dataCacheHits;
+}
+
+quint64 Utils::ModelListModel::dataCacheMisses() const
+{
+	return m_dataCacheMisses;
+}
+
+int Utils::ModelListModel::sortRole() const
+{
+	return m_sortRole;
+}
+
+void Utils::ModelListModel::setSortRole(int role)
+{
+	if (m_sortRole == role)
+		return;
+	m_sortRole = role;
+	if (isMerged())
+	{
+		beginResetModel();
+		m_pendingDataChanges.clear(); //see setFlat
+		rebuildMergedOrder();
+		endResetModel();
+	}
+}
+
+int Utils::ModelListModel::searchRole() const
+{
+	return m_searchRole;
+}
+
+void Utils::ModelListModel::setSearchRole(int role)
+{
+	if (m_searchRole == role)
+		return;
+	m_searchRole = role;
+	qDeleteAll(m_searchIndexes);
+	m_searchIndexes.clear();
+	m_searchBuilds.clear();
+	if (m_searchRole != -1)
+	{
+		foreach (QAbstractItemModel* subModel, m_subModels)
+			buildSearchIndex(subModel, true);
+	}
+}
+
+QList<int> Utils::ModelListModel::findRows(QAbstractItemModel* subModel, const QString& text) const
+{
+	const SearchIndex* index = m_searchIndexes.value(subModel);
+	if (!index)
+		return QList<int>();
+	return index->match(text.toCaseFolded());
+}
+
+QHash<QAbstractItemModel*, QList<int> > Utils::ModelListModel::findRows(const QString& text) const
+{
+	const QString foldedText = text.toCaseFolded();
+	QHash<QAbstractItemModel*, QList<int> > result;
+	QHash<QAbstractItemModel*, SearchIndex*>::const_iterator it = m_searchIndexes.constBegin(), end = m_searchIndexes.constEnd();
+	for (; it != end; ++it)
+	{
+		const QList<int> rows = it.value()->match(foldedText);
+		if (!rows.isEmpty())
+			result.insert(it.key(), rows);
+	}
+	return result;
+}
+
 QModelIndex Utils::ModelListModel::mapFromSource(const Utils::ModelListModel::SubModelIndex& index) const
 {
 	//validate input
@@ -127,18 +291,25 @@ QModelIndex Utils::ModelListModel::mapFromSource(const Utils::ModelListModel::Su
 		//the root item of the metamodel is the root item of the modellistmodel
 		if (subModel == m_metaModel)
 			return QModelIndex();
-		//the root item of a submodel is the respective item in the metamodel
+		//the root item of a submodel is the respective item in the metamodel (or the root item in flat mode, where the metamodel is not visible)
+		else if (m_flat)
+			return QModelIndex();
 		else
 		{
-			int modelPos = m_subModels.indexOf(subModel);
-			return createIndex(modelPos, 0, subModel);
+			int modelPos = m_subModelRows.value(subModel);
+			return createIndex(modelPos, 0, quint32(MetaNode));
 		}
 	}
 	else if (subIndex.model() != subModel)
 		return QModelIndex();
-	//encode the submodel that is responsible for this item into the internal pointer of the model index
-	//NOTE: Exactly this is the reason why we cannot embed tree-shaped models into the modellistmodel.
-	return createIndex(subIndex.row(), subIndex.column(), subModel);
+	if (subModel == m_metaModel)
+		return m_flat ? QModelIndex() : createIndex(subIndex.row(), subIndex.column(), quint32(MetaNode));
+	//encode the parent of this item into the internal ID of the model index
+	const QModelIndex sourceParent = subIndex.parent();
+	if (sourceParent.isValid())
+		return createIndex(subIndex.row(), subIndex.column(), quint32(nodeFor(subModel, sourceParent)));
+	const int row = m_flat ? flatRow(subModel, subIndex.row()) : subIndex.row();
+	return createIndex(row, subIndex.column(), quint32(m_rootNodes.value(subModel)));
 }
 
 Utils::ModelListModel::SubModelIndex Utils::ModelListModel::mapToSource(const QModelIndex& index) const
@@ -147,271 +318,1872 @@ Utils::ModelListModel::SubModelIndex Utils::ModelListModel::mapToSource(const QM
 	//ensure that the root item of the modellistmodel is provided by the metamodel
 	if (!index.isValid())
 		return qMakePair(metaModel, QModelIndex());
-	//find the source model for this index
-	QAbstractItemModel* subModel = safeModelCast(index.internalPointer());
-	if (!subModel)
+	//find the source model and parent for this index
+	const Node* node = nodeAt(index.internalId());
+	if (!node || (!node->isRoot && !node->sourceParent.isValid())) //the latter is a node of a removed item which has not been recycled yet
 		return qMakePair(metaModel, QModelIndex());
+	QAbstractItemModel* subModel = node->model;
 	//create new index for source model
-	QModelIndex subIndex = subModel->index(index.row(), index.column());
+	QModelIndex subIndex = subModel->index(sourceRow(index, *node), index.column(), node->sourceParent);
 	return qMakePair(subModel, subIndex);
 }
 
 QAbstractItemModel* Utils::ModelListModel::safeModelCast(void* model) const
 {
 	QAbstractItemModel* modelPtr = reinterpret_cast<QAbstractItemModel*>(model);
-	bool knownModel = m_subModels.contains(modelPtr) || modelPtr == m_metaModel;
+	bool knownModel = modelPtr == m_metaModel || m_subModelRows.contains(modelPtr);
 	return knownModel ? modelPtr : 0;
 }
 
-//BEGIN QAbstractItemModel reimplementation
-//NOTE on the general implementation: We use mapToSource, and transfer the call to the appropriate submodel. Special cases are only necessary at those places where the submodels are "mounted" into the base tree provided by the meta model.
+int Utils::ModelListModel::rowOffset(QAbstractItemModel* subModel) const
+{
+	return m_rowOffsets.offset(m_subModelRows.value(subModel));
+}
 
-int Utils::ModelListModel::columnCount(const QModelIndex& parent) const
+int Utils::ModelListModel::sourceRow(const QModelIndex& index, const Node& node) const
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
-	if (smi.first == m_metaModel && smi.second.isValid())
-	{
-		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
-		if (subModel)
-			return subModel->columnCount();
-	}
-	return smi.first->columnCount(smi.second);
+	if (!m_flat || !node.isRoot || node.model == m_metaModel)
+		return index.row();
+	return isMerged() ? m_mergedOrder.sourceRowAt(index.row()) : index.row() - rowOffset(node.model);
 }
 
-QVariant Utils::ModelListModel::data(const QModelIndex& index, int role) const
+int Utils::ModelListModel::flatRow(QAbstractItemModel* subModel, int sourceRow) const
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
-	return smi.first->data(smi.second, role);
+	if (isMerged())
+		return m_mergedOrder.rowOf(m_subModelRows.value(subModel), sourceRow);
+	return sourceRow + rowOffset(subModel);
 }
 
-Qt::ItemFlags Utils::ModelListModel::flags(const QModelIndex& index) const
+bool Utils::ModelListModel::isMerged() const
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
-	return smi.first->flags(smi.second);
+	return m_flat && m_sortColumn != -1;
 }
 
-QVariant Utils::ModelListModel::headerData(int section, Qt::Orientation orientation, int role) const
+int Utils::ModelListModel::subModelColumnCount() const
 {
-	if (m_headerDataSubModel)
-		return m_headerDataSubModel->headerData(section, orientation, role);
-	else
-		return QAbstractItemModel::headerData(section, orientation, role);
+	int columnCount = 0;
+	foreach (QAbstractItemModel* subModel, m_subModels)
+		columnCount = qMax(columnCount, subModel->columnCount());
+	return columnCount;
 }
 
-QModelIndex Utils::ModelListModel::index(int row, int column, const QModelIndex& parent) const
+void Utils::ModelListModel::updateFlatColumnCount()
 {
-	//read parent modelindex
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
-	//create SubModelIndex for child
-	Utils::ModelListModel::SubModelIndex newSmi;
-	if (smi.first == m_metaModel && smi.second.isValid())
+	//NOTE: This may not be called during another structural change of the root level, because the column change is announced separately.
+	const int columnCount = subModelColumnCount();
+	if (!m_flat || columnCount == m_flatColumnCount)
+		m_flatColumnCount = columnCount;
+	else if (columnCount > m_flatColumnCount)
 	{
-		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
-		if (subModel)
-		{
-			newSmi.first = subModel;
-			newSmi.second = subModel->index(row, column);
-		}
-		else
-		{
-			newSmi.first = smi.first;
-			newSmi.second = smi.first->index(row, column, smi.second);
-		}
+		beginInsertColumns(QModelIndex(), m_flatColumnCount, columnCount - 1);
+		m_flatColumnCount = columnCount;
+		endInsertColumns();
 	}
 	else
 	{
-		newSmi.first = smi.first;
-		newSmi.second = smi.first->index(row, column, smi.second);
+		beginRemoveColumns(QModelIndex(), columnCount, m_flatColumnCount - 1);
+		m_flatColumnCount = columnCount;
+		endRemoveColumns();
 	}
-	//collapse into modelindex
-	return mapFromSource(newSmi);
 }
 
-bool Utils::ModelListModel::insertColumns(int column, int count, const QModelIndex& parent)
+Utils::ModelListModel::MoveForwarding Utils::ModelListModel::moveForwarding(const QModelIndex& sourceParent, const QModelIndex& destinationParent, Qt::Orientation orientation) const
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
-	if (smi.first == m_metaModel && smi.second.parent().isValid())
-	{
-		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
-		if (subModel)
-			return subModel->insertColumns(column, count);
-	}
-	return smi.first->insertColumns(column, count, smi.second);
+	if (orientation == Qt::Horizontal)
+		return m_flat ? ForwardReset : ForwardMove; //the columns of the root level are shared by all submodels in flat mode (see handleColumnsAboutToBeInserted)
+	if (!isMerged() || (sourceParent.isValid() && destinationParent.isValid()))
+		return ForwardMove;
+	//in sorted flat mode, the position of a root-level row does not depend on its source row, and moves between the root level and other parents change the number of scattered root-level rows
+	return sourceParent == destinationParent ? ForwardLayoutChange : ForwardReset;
 }
 
-bool Utils::ModelListModel::insertRows(int row, int count, const QModelIndex& parent)
+void Utils::ModelListModel::invalidateMovedData(QAbstractItemModel* subModel, const QModelIndex& sourceParent, int sourceStart, const QModelIndex& destinationParent, int destination, Qt::Orientation orientation) const
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
-	if (smi.first == m_metaModel && smi.second.parent().isValid())
+	//the moved items and all items behind them (in both parents) change their positions
+	const int sourceFirst = sourceParent == destinationParent ? qMin(sourceStart, destination) : sourceStart;
+	const int sourceNode = existingNodeFor(subModel, sourceParent), destinationNode = existingNodeFor(subModel, destinationParent);
+	if (orientation == Qt::Vertical)
 	{
-		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
-		if (subModel)
-			return subModel->insertRows(row, count);
+		invalidateDataCache(sourceNode, sourceFirst, INT_MAX, 0, INT_MAX);
+		if (destinationNode != sourceNode)
+			invalidateDataCache(destinationNode, destination, INT_MAX, 0, INT_MAX);
+	}
+	else
+	{
+		invalidateDataCache(sourceNode, 0, INT_MAX, sourceFirst, INT_MAX);
+		if (destinationNode != sourceNode)
+			invalidateDataCache(destinationNode, 0, INT_MAX, destination, INT_MAX);
 	}
-	return smi.first->insertRows(row, count, smi.second);
 }
 
-QMap<int, QVariant> Utils::ModelListModel::itemData(const QModelIndex& index) const
+void Utils::ModelListModel::rekeyMovedNodes(QAbstractItemModel* subModel, const QModelIndex& sourceParent, int sourceStart, const QModelIndex& destinationParent, int destination, Qt::Orientation orientation)
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
-	return smi.first->itemData(smi.second);
+	//within one parent, only the keys from the first moved position onwards are outdated; items which moved to another parent have to be linked to the node of this parent, which only the full rekeying does
+	if (sourceParent == destinationParent)
+		rekeyNodes(subModel, sourceParent, qMin(sourceStart, destination), orientation);
+	else
+		rekeyNodes(subModel);
 }
 
-QModelIndex Utils::ModelListModel::parent(const QModelIndex& index) const
+QVariant Utils::ModelListModel::sortKey(QAbstractItemModel* subModel, int sourceRow) const
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
-	QModelIndex parent = smi.first->parent(smi.second);
-	if (smi.first == m_metaModel || parent.isValid())
-		return parent;
-	else
-	{
-		//This item from a submodel has a parent in the metamodel.
-		Utils::ModelListModel::SubModelIndex smiParent;
-		smiParent.first = m_metaModel;
-		smiParent.second = m_metaModel->index(m_subModels.indexOf(smi.first), 0);
-		return mapFromSource(smiParent);
-	}
+	return subModel->data(subModel->index(sourceRow, m_sortColumn), m_sortRole);
 }
 
-bool Utils::ModelListModel::removeColumns(int column, int count, const QModelIndex& parent)
+void Utils::ModelListModel::rebuildMergedOrder()
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
-	if (smi.first == m_metaModel && smi.second.parent().isValid())
+	//NOTE: This has to be called between beginResetModel() and endResetModel().
+	if (!isMerged())
 	{
-		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
-		if (subModel)
-			return subModel->removeColumns(column, count);
+		m_mergedOrder.clear();
+		return;
 	}
-	return smi.first->removeColumns(column, count, smi.second);
+	QVector<QVector<QVariant> > keys(m_subModels.count());
+	for (int i = 0; i < m_subModels.count(); ++i)
+	{
+		QAbstractItemModel* subModel = m_subModels[i];
+		QVector<QVariant>& subModelKeys = keys[i];
+		subModelKeys.resize(subModel->rowCount());
+		for (int row = 0; row < subModelKeys.count(); ++row)
+			subModelKeys[row] = sortKey(subModel, row);
+	}
+	m_mergedOrder.build(keys, m_sortOrder);
 }
 
-bool Utils::ModelListModel::removeRows(int row, int count, const QModelIndex& parent)
+void Utils::ModelListModel::beginLayoutChange(QAbstractItemModel* subModel)
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
-	if (smi.first == m_metaModel && smi.second.parent().isValid())
+	emit layoutAboutToBeChanged();
+	//remember the persistent indexes which may move (those of the given submodel, if any, and in sorted flat mode the root-level rows of all submodels), and where they come from
+	//NOTE: Qt cannot look up the persistent indexes of one submodel, so all of them are scanned, but only the node of an unaffected index is looked at.
+	const QModelIndexList indexes = persistentIndexList();
+	if (indexes.isEmpty())
+		return;
+	const bool merged = isMerged();
+	foreach (const QModelIndex& index, indexes)
 	{
-		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
-		if (subModel)
-			return subModel->removeRows(row, count);
+		const Node* node = nodeAt(index.internalId());
+		if (!node)
+			continue;
+		if (subModel && node->model == subModel)
+		{
+			m_layoutProxyIndexes << index;
+			m_layoutSourceIndexes << QPersistentModelIndex(mapToSource(index).second);
+		}
+		else if (merged && node->isRoot && node->model != m_metaModel)
+		{
+			m_layoutMergedIndexes << index;
+			m_layoutMergedRows << qMakePair(m_mergedOrder.subModelAt(index.row()), m_mergedOrder.sourceRowAt(index.row()));
+		}
 	}
-	return smi.first->removeRows(row, count, smi.second);
 }
 
-int Utils::ModelListModel::rowCount(const QModelIndex& parent) const
+void Utils::ModelListModel::endLayoutChange()
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
-	if (smi.first == m_metaModel && smi.second.isValid())
+	//move the persistent indexes
+	QModelIndexList oldIndexes = m_layoutProxyIndexes, newIndexes;
+	foreach (const QPersistentModelIndex& sourceIndex, m_layoutSourceIndexes)
+		newIndexes << mapFromSource(qMakePair(const_cast<QAbstractItemModel*>(sourceIndex.model()), QModelIndex(sourceIndex)));
+	for (int i = 0; i < m_layoutMergedIndexes.count(); ++i)
 	{
-		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
-		if (subModel)
-			return subModel->rowCount();
+		const QModelIndex& index = m_layoutMergedIndexes[i];
+		const int row = m_mergedOrder.rowOf(m_layoutMergedRows[i].first, m_layoutMergedRows[i].second);
+		oldIndexes << index;
+		newIndexes << (row == -1 ? QModelIndex() : createIndex(row, index.column(), quint32(index.internalId())));
 	}
-	return smi.first->rowCount(smi.second);
+	changePersistentIndexList(oldIndexes, newIndexes);
+	m_layoutProxyIndexes.clear();
+	m_layoutSourceIndexes.clear();
+	m_layoutMergedIndexes.clear();
+	m_layoutMergedRows.clear();
+	emit layoutChanged();
 }
 
-bool Utils::ModelListModel::setData(const QModelIndex& index, const QVariant& value, int role)
+const Utils::ModelListModel::Node* Utils::ModelListModel::nodeAt(qint64 id) const
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
-	return smi.first->setData(smi.second, value, role);
+	if (id < 0 || id >= m_nodes.count() || !m_nodes[id].model)
+		return 0;
+	return &m_nodes[id];
 }
 
-bool Utils::ModelListModel::setHeaderData(int section, Qt::Orientation orientation, const QVariant& value, int role)
+int Utils::ModelListModel::nodeFor(QAbstractItemModel* subModel, const QModelIndex& sourceParent) const
 {
-	if (m_headerDataSubModel)
-		return m_headerDataSubModel->setHeaderData(section, orientation, value, role);
-	else
-		return QAbstractItemModel::setHeaderData(section, orientation, value, role);
+	QHash<QModelIndex, int>::const_iterator it = m_nodeIds.constFind(sourceParent);
+	if (it != m_nodeIds.constEnd())
+		return it.value();
+	//the node of the parent has to exist first, to link the new node into the tree
+	const QModelIndex grandParent = sourceParent.parent();
+	const int parentId = grandParent.isValid() ? nodeFor(subModel, grandParent) : m_rootNodes.value(subModel);
+	const int id = allocateNode(subModel, sourceParent, false);
+	m_nodes[parentId].children << id;
+	m_nodeIds.insert(sourceParent, id);
+	return id;
 }
 
-bool Utils::ModelListModel::setItemData(const QModelIndex& index, const QMap<int, QVariant>& roles)
+int Utils::ModelListModel::allocateNode(QAbstractItemModel* subModel, const QModelIndex& sourceParent, bool isRoot) const
 {
-	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
-	return smi.first->setItemData(smi.second, roles);
+	int id;
+	if (m_freeNodes.isEmpty())
+	{
+		id = m_nodes.count();
+		m_nodes.resize(id + 1);
+	}
+	else
+	{
+		id = m_freeNodes.last();
+		m_freeNodes.pop_back();
+	}
+	Node& node = m_nodes[id];
+	node.model = subModel;
+	node.sourceParent = sourceParent;
+	node.key = sourceParent;
+	node.isRoot = isRoot;
+	return id;
 }
 
-void Utils::ModelListModel::revert()
+void Utils::ModelListModel::freeNode(int id) const
 {
-	m_metaModel->revert();
-	foreach (QAbstractItemModel* subModel, m_subModels)
-		subModel->revert();
+	invalidateDataCache(id, 0, INT_MAX, 0, INT_MAX); //the ID will be reused for another parent
+	Node& node = m_nodes[id];
+	node.model = 0;
+	node.sourceParent = QPersistentModelIndex();
+	node.key = QModelIndex();
+	node.children.clear();
+	m_freeNodes << id;
 }
 
-bool Utils::ModelListModel::submit()
+void Utils::ModelListModel::freeNodeTree(int id) const
 {
-	bool success = m_metaModel->submit();
-	foreach (QAbstractItemModel* subModel, m_subModels)
-		success &= subModel->submit();
-	return success;
+	//NOTE: The caller has to remove the key of the node itself from m_nodeIds, and the node from the children of its parent.
+	foreach (int child, m_nodes[id].children)
+	{
+		m_nodeIds.remove(m_nodes[child].key);
+		freeNodeTree(child);
+	}
+	freeNode(id);
 }
 
-//END QAbstractItemModel reimplementation
-
-//BEGIN event propagation for submodels
-//WARNING: This stuff is largely untested. Only insertion/removal of rows in submodels is known to work.
-
-void Utils::ModelListModel::handleColumnsAboutToBeInserted(const QModelIndex& parent, int start, int end)
+void Utils::ModelListModel::collectNodes(int id, QVector<int>& ids) const
 {
-	QAbstractItemModel* senderModel = safeModelCast(sender());
-	beginInsertColumns(mapFromSource(qMakePair(senderModel, parent)), start, end);
+	ids << id;
+	foreach (int child, m_nodes[id].children)
+		collectNodes(child, ids);
 }
 
-void Utils::ModelListModel::handleColumnsAboutToBeRemoved(const QModelIndex& parent, int start, int end)
+void Utils::ModelListModel::rekeyNodes(QAbstractItemModel* subModel)
 {
-	QAbstractItemModel* senderModel = safeModelCast(sender());
-	beginRemoveColumns(mapFromSource(qMakePair(senderModel, parent)), start, end);
+	//The keys in m_nodeIds are plain indexes, which are outdated after layout changes and resets. The persistent indexes have been updated by the submodel, though.
+	const int rootId = m_rootNodes.value(subModel, -1);
+	if (rootId == -1)
+		return;
+	QVector<int> ids;
+	collectNodes(rootId, ids);
+	ids.remove(0); //the root node has no key
+	//remove all old keys first, because an old key may be equal to the new key of another node
+	m_nodes[rootId].children.clear();
+	foreach (int id, ids)
+	{
+		m_nodeIds.remove(m_nodes[id].key);
+		m_nodes[id].children.clear();
+	}
+	QVector<int> keptIds;
+	foreach (int id, ids)
+	{
+		Node& node = m_nodes[id];
+		if (node.sourceParent.isValid())
+		{
+			node.key = node.sourceParent;
+			m_nodeIds.insert(node.key, id);
+			keptIds << id;
+		}
+		else
+			freeNode(id); //the item has been removed
+	}
+	//the items may have moved to other parents, so the tree is linked again
+	foreach (int id, keptIds)
+	{
+		const QModelIndex grandParent = m_nodes[id].sourceParent.parent();
+		const int parentId = grandParent.isValid() ? nodeFor(subModel, grandParent) : rootId;
+		m_nodes[parentId].children << id;
+	}
 }
 
-void Utils::ModelListModel::handleColumnsInserted()
+void Utils::ModelListModel::rekeyNodes(QAbstractItemModel* subModel, const QModelIndex& sourceParent, int start, Qt::Orientation orientation)
 {
-	endInsertColumns();
-	emit layoutChanged();
+	//After rows (or columns) have been inserted or removed below sourceParent, only the keys of the children from the start row (or column) onwards are outdated, because the plain indexes of their descendants do not contain their positions. The persistent indexes have been updated by the submodel, though.
+	const int parentId = existingNodeFor(subModel, sourceParent);
+	if (parentId == -1)
+		return;
+	const QVector<int> children = m_nodes[parentId].children;
+	QVector<int> keptChildren, movedChildren;
+	//remove all old keys first, because an old key may be equal to the new key of another node
+	foreach (int id, children)
+	{
+		const QModelIndex& key = m_nodes[id].key;
+		if ((orientation == Qt::Vertical ? key.row() : key.column()) < start)
+		{
+			keptChildren << id;
+			continue;
+		}
+		m_nodeIds.remove(key);
+		if (m_nodes[id].sourceParent.isValid())
+		{
+			keptChildren << id;
+			movedChildren << id;
+		}
+		else
+			freeNodeTree(id); //the item has been removed
+	}
+	m_nodes[parentId].children = keptChildren;
+	foreach (int id, movedChildren)
+	{
+		Node& node = m_nodes[id];
+		node.key = node.sourceParent;
+		m_nodeIds.insert(node.key, id);
+	}
 }
 
-void Utils::ModelListModel::handleColumnsRemoved()
+int Utils::ModelListModel::existingNodeFor(QAbstractItemModel* subModel, const QModelIndex& sourceParent) const
 {
-	endRemoveColumns();
-	emit layoutChanged();
+	if (!sourceParent.isValid())
+		return m_rootNodes.value(subModel, -1);
+	return m_nodeIds.value(sourceParent, -1);
 }
 
-void Utils::ModelListModel::handleDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+void Utils::ModelListModel::invalidateDataCache(QAbstractItemModel* subModel) const
 {
-	QAbstractItemModel* senderModel = safeModelCast(sender());
-	emit dataChanged(mapFromSource(qMakePair(senderModel, topLeft)), mapFromSource(qMakePair(senderModel, bottomRight)));
+	const int rootId = m_rootNodes.value(subModel, -1);
+	if (rootId == -1)
+		return;
+	QVector<int> ids;
+	collectNodes(rootId, ids);
+	foreach (int id, ids)
+		invalidateDataCache(id, 0, INT_MAX, 0, INT_MAX);
 }
 
-void Utils::ModelListModel::handleHeaderDataChanged(Qt::Orientation orientation, int first, int last) //NOTE: check sender() == m_headerDataSubModel
+void Utils::ModelListModel::invalidateDataCache(int node, int firstRow, int lastRow, int firstColumn, int lastColumn) const
 {
-	if (sender() == m_headerDataSubModel)
-		emit headerDataChanged(orientation, first, last);
+	//QCache cannot be searched by parts of the key, so the side index m_dataCacheKeys is used to find the affected keys
+	if (node == -1)
+		return;
+	QHash<int, DataCacheRows>::iterator it = m_dataCacheKeys.find(node);
+	if (it == m_dataCacheKeys.end())
+		return;
+	if (firstRow <= 0 && lastRow == INT_MAX && firstColumn <= 0 && lastColumn == INT_MAX)
+	{
+		//drop the side index of this node first, so the entries need not remove themselves one by one
+		const DataCacheRows rows = m_dataCacheKeys.take(node);
+		foreach (const DataCacheKey& key, rows)
+			m_dataCache.remove(key);
+		return;
+	}
+	QVector<DataCacheKey> keys;
+	const DataCacheRows& rows = it.value();
+	for (DataCacheRows::const_iterator rowIt = rows.lowerBound(firstRow); rowIt != rows.constEnd() && rowIt.key() <= lastRow; ++rowIt)
+	{
+		const DataCacheKey& key = rowIt.value();
+		if (key.column >= firstColumn && key.column <= lastColumn)
+			keys << key;
+	}
+	foreach (const DataCacheKey& key, keys) //the side index cannot be iterated while the entries remove themselves from it
+		m_dataCache.remove(key);
 }
 
-void Utils::ModelListModel::handleRowsAboutToBeInserted(const QModelIndex& parent, int start, int end)
+Utils::ModelListModel::DataCacheEntry::~DataCacheEntry()
 {
-	QAbstractItemModel* senderModel = safeModelCast(sender());
-	beginInsertRows(mapFromSource(qMakePair(senderModel, parent)), start, end);
+	QHash<int, DataCacheRows>::iterator it = keysByNode->find(key.node);
+	if (it == keysByNode->end())
+		return; //the whole node is being invalidated
+	it->remove(key.row, key);
+	if (it->isEmpty())
+		keysByNode->erase(it);
 }
 
-void Utils::ModelListModel::handleRowsAboutToBeRemoved(const QModelIndex& parent, int start, int end)
+QVector<QString> Utils::ModelListModel::searchTexts(QAbstractItemModel* subModel, int first, int last) const
 {
-	QAbstractItemModel* senderModel = safeModelCast(sender());
-	beginRemoveRows(mapFromSource(qMakePair(senderModel, parent)), start, end);
+	QVector<QString> texts(qMax(last - first + 1, 0));
+	for (int row = first; row <= last; ++row)
+		texts[row - first] = subModel->data(subModel->index(row, 0), m_searchRole).toString().toCaseFolded();
+	return texts;
 }
 
-void Utils::ModelListModel::handleRowsInserted()
+void Utils::ModelListModel::buildSearchIndex(QAbstractItemModel* subModel, bool readTexts)
 {
-	endInsertRows();
-	emit layoutChanged();
+	SearchIndex*& index = m_searchIndexes[subModel];
+	if (!index)
+		index = new SearchIndex;
+	//the texts have to be read in this thread because models are not thread-safe, only the indexing is done in the background (this blocks for one data() call per row, see class documentation)
+	if (readTexts)
+		index->setTexts(searchTexts(subModel, 0, subModel->rowCount() - 1));
+	QFutureWatcher<SearchIndex::Postings>* watcher = new QFutureWatcher<SearchIndex::Postings>(this);
+	connect(watcher, SIGNAL(finished()), this, SLOT(handleSearchIndexBuilt()));
+	m_searchBuilds.insert(subModel, watcher); //a previous build of this submodel is superseded
+	watcher->setFuture(QtConcurrent::run(&SearchIndex::buildPostings, index->beginBuild()));
 }
 
-void Utils::ModelListModel::handleRowsRemoved()
+void Utils::ModelListModel::updateSearchIndex(QAbstractItemModel* subModel)
 {
-	endRemoveRows();
-	emit layoutChanged();
+	//unchanged texts keep their items, so a rebuild is only necessary if many texts have changed
+	SearchIndex* index = m_searchIndexes.value(subModel);
+	if (!index)
+		return;
+	index->setTexts(searchTexts(subModel, 0, subModel->rowCount() - 1));
+	if (index->needsRebuild() && !m_searchBuilds.contains(subModel))
+		buildSearchIndex(subModel, false);
 }
 
-void Utils::ModelListModel::handleSubModelDeleted(QObject* model)
+void Utils::ModelListModel::handleSearchIndexBuilt()
 {
-	removeSubModel(reinterpret_cast<QAbstractItemModel*>(model));
+	QFutureWatcher<SearchIndex::Postings>* watcher = static_cast<QFutureWatcher<SearchIndex::Postings>*>(sender());
+	watcher->deleteLater();
+	QAbstractItemModel* subModel = m_searchBuilds.key(watcher);
+	if (!subModel)
+		return; //superseded or the submodel has been removed
+	m_searchBuilds.remove(subModel);
+	m_searchIndexes.value(subModel)->endBuild(watcher->result());
 }
 
-//END event propagation for submodels
+//BEGIN QAbstractItemModel reimplementation
+//NOTE on the general implementation: We use mapToSource, and transfer the call to the appropriate submodel. Special cases are only necessary at those places where the submodels are "mounted" into the base tree provided by the meta model.
+
+bool Utils::ModelListModel::canFetchMore(const QModelIndex& parent) const
+{
+	if (m_flat && !parent.isValid())
+	{
+		foreach (QAbstractItemModel* subModel, m_subModels)
+			if (subModel->canFetchMore(QModelIndex()))
+				return true;
+		return false;
+	}
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
+	if (smi.first == m_metaModel && smi.second.isValid())
+	{
+		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
+		if (subModel)
+			return subModel->canFetchMore(QModelIndex());
+	}
+	return smi.first->canFetchMore(smi.second);
+}
+
+int Utils::ModelListModel::columnCount(const QModelIndex& parent) const
+{
+	if (m_flat && !parent.isValid())
+		return m_flatColumnCount;
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
+	if (smi.first == m_metaModel && smi.second.isValid())
+	{
+		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
+		if (subModel)
+			return subModel->columnCount();
+	}
+	return smi.first->columnCount(smi.second);
+}
+
+QVariant Utils::ModelListModel::data(const QModelIndex& index, int role) const
+{
+	//look into the cache first (except for items of the metamodel, which are cheap anyway)
+	const Node* node = (m_dataCache.maxCost() > 0 && index.isValid()) ? nodeAt(index.internalId()) : 0;
+	if (!node || node->model == m_metaModel || (!node->isRoot && !node->sourceParent.isValid()))
+	{
+		Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
+		return smi.first->data(smi.second, role);
+	}
+	const DataCacheKey key = { int(index.internalId()), sourceRow(index, *node), index.column(), role };
+	if (const DataCacheEntry* entry = m_dataCache.object(key))
+	{
+		++m_dataCacheHits;
+		return entry->value;
+	}
+	++m_dataCacheMisses;
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
+	const QVariant value = smi.first->data(smi.second, role);
+	m_dataCacheKeys[key.node].insert(key.row, key); //before the insertion, which may delete the entry right away
+	m_dataCache.insert(key, new DataCacheEntry(value, key, &m_dataCacheKeys));
+	return value;
+}
+
+void Utils::ModelListModel::fetchMore(const QModelIndex& parent)
+{
+	if (m_flat && !parent.isValid())
+	{
+		foreach (QAbstractItemModel* subModel, m_subModels)
+		{
+			if (subModel->canFetchMore(QModelIndex()))
+			{
+				subModel->fetchMore(QModelIndex());
+				return;
+			}
+		}
+		return;
+	}
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
+	if (smi.first == m_metaModel && smi.second.isValid())
+	{
+		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
+		if (subModel)
+		{
+			subModel->fetchMore(QModelIndex());
+			return;
+		}
+	}
+	smi.first->fetchMore(smi.second);
+}
+
+Qt::ItemFlags Utils::ModelListModel::flags(const QModelIndex& index) const
+{
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
+	return smi.first->flags(smi.second);
+}
+
+QVariant Utils::ModelListModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (m_headerDataSubModel)
+		return m_headerDataSubModel->headerData(section, orientation, role);
+	else
+		return QAbstractItemModel::headerData(section, orientation, role);
+}
+
+QModelIndex Utils::ModelListModel::index(int row, int column, const QModelIndex& parent) const
+{
+	if (isMerged() && !parent.isValid())
+	{
+		if (row < 0 || row >= m_mergedOrder.count())
+			return QModelIndex();
+		//build the index directly, because mapFromSource() would need a binary search to find the row again
+		QAbstractItemModel* subModel = m_subModels[m_mergedOrder.subModelAt(row)];
+		if (!subModel->hasIndex(m_mergedOrder.sourceRowAt(row), column))
+			return QModelIndex();
+		return createIndex(row, column, quint32(m_rootNodes.value(subModel)));
+	}
+	if (m_flat && !parent.isValid())
+	{
+		const int subModelIndex = m_rowOffsets.indexOf(row);
+		if (subModelIndex == -1)
+			return QModelIndex();
+		QAbstractItemModel* subModel = m_subModels[subModelIndex];
+		return mapFromSource(qMakePair(subModel, subModel->index(row - m_rowOffsets.offset(subModelIndex), column)));
+	}
+	//read parent modelindex
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
+	//create SubModelIndex for child
+	Utils::ModelListModel::SubModelIndex newSmi;
+	if (smi.first == m_metaModel && smi.second.isValid())
+	{
+		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
+		if (subModel)
+		{
+			newSmi.first = subModel;
+			newSmi.second = subModel->index(row, column);
+		}
+		else
+		{
+			newSmi.first = smi.first;
+			newSmi.second = smi.first->index(row, column, smi.second);
+		}
+	}
+	else
+	{
+		newSmi.first = smi.first;
+		newSmi.second = smi.first->index(row, column, smi.second);
+	}
+	//collapse into modelindex
+	return mapFromSource(newSmi);
+}
+
+bool Utils::ModelListModel::insertColumns(int column, int count, const QModelIndex& parent)
+{
+	if (m_flat && !parent.isValid())
+		return false; //the columns of the root level are shared by all submodels
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
+	if (smi.first == m_metaModel && smi.second.parent().isValid())
+	{
+		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
+		if (subModel)
+			return subModel->insertColumns(column, count);
+	}
+	return smi.first->insertColumns(column, count, smi.second);
+}
+
+bool Utils::ModelListModel::insertRows(int row, int count, const QModelIndex& parent)
+{
+	if (isMerged() && !parent.isValid())
+		return false; //the position of new rows is determined by their data
+	if (m_flat && !parent.isValid())
+	{
+		//insert into the submodel which contains the given row (or append to the last submodel)
+		const int totalRowCount = m_rowOffsets.total();
+		if (m_subModels.isEmpty() || row < 0 || row > totalRowCount)
+			return false;
+		const int subModelIndex = row < totalRowCount ? m_rowOffsets.indexOf(row) : m_subModels.count() - 1;
+		return m_subModels[subModelIndex]->insertRows(row - m_rowOffsets.offset(subModelIndex), count);
+	}
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
+	if (smi.first == m_metaModel && smi.second.parent().isValid())
+	{
+		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
+		if (subModel)
+			return subModel->insertRows(row, count);
+	}
+	return smi.first->insertRows(row, count, smi.second);
+}
+
+QMap<int, QVariant> Utils::ModelListModel::itemData(const QModelIndex& index) const
+{
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
+	return smi.first->itemData(smi.second);
+}
+
+QModelIndex Utils::ModelListModel::parent(const QModelIndex& index) const
+{
+	//the node of this index describes its parent
+	const Node* node = index.isValid() ? nodeAt(index.internalId()) : 0;
+	if (!node || node->model == m_metaModel)
+		return QModelIndex();
+	if (node->isRoot)
+	{
+		//This item from a submodel has a parent in the metamodel (unless in flat mode).
+		if (m_flat)
+			return QModelIndex();
+		return createIndex(m_subModelRows.value(node->model), 0, quint32(MetaNode));
+	}
+	return mapFromSource(qMakePair(node->model, QModelIndex(node->sourceParent)));
+}
+
+bool Utils::ModelListModel::removeColumns(int column, int count, const QModelIndex& parent)
+{
+	if (m_flat && !parent.isValid())
+		return false; //the columns of the root level are shared by all submodels
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
+	if (smi.first == m_metaModel && smi.second.parent().isValid())
+	{
+		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
+		if (subModel)
+			return subModel->removeColumns(column, count);
+	}
+	return smi.first->removeColumns(column, count, smi.second);
+}
+
+bool Utils::ModelListModel::removeRows(int row, int count, const QModelIndex& parent)
+{
+	if (isMerged() && !parent.isValid())
+	{
+		//adjacent rows are usually not adjacent in the submodels
+		if (count != 1 || row < 0 || row >= m_mergedOrder.count())
+			return false;
+		return m_subModels[m_mergedOrder.subModelAt(row)]->removeRows(m_mergedOrder.sourceRowAt(row), 1);
+	}
+	if (m_flat && !parent.isValid())
+	{
+		//only ranges within one submodel can be removed
+		const int subModelIndex = m_rowOffsets.indexOf(row);
+		if (subModelIndex == -1 || count <= 0)
+			return false;
+		const int subModelRow = row - m_rowOffsets.offset(subModelIndex);
+		if (subModelRow + count > m_rowOffsets.count(subModelIndex))
+			return false;
+		return m_subModels[subModelIndex]->removeRows(subModelRow, count);
+	}
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
+	if (smi.first == m_metaModel && smi.second.parent().isValid())
+	{
+		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
+		if (subModel)
+			return subModel->removeRows(row, count);
+	}
+	return smi.first->removeRows(row, count, smi.second);
+}
+
+int Utils::ModelListModel::rowCount(const QModelIndex& parent) const
+{
+	if (m_flat && !parent.isValid())
+		return isMerged() ? m_mergedOrder.count() : m_rowOffsets.total(); //these differ while a submodel change is being forwarded
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(parent);
+	if (smi.first == m_metaModel && smi.second.isValid())
+	{
+		QAbstractItemModel* subModel = m_subModels.value(smi.second.row());
+		if (subModel)
+			return m_resettingSubModels.contains(subModel) ? 0 : subModel->rowCount(); //see handleModelAboutToBeReset
+	}
+	return smi.first->rowCount(smi.second);
+}
+
+bool Utils::ModelListModel::setData(const QModelIndex& index, const QVariant& value, int role)
+{
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
+	return smi.first->setData(smi.second, value, role);
+}
+
+bool Utils::ModelListModel::setHeaderData(int section, Qt::Orientation orientation, const QVariant& value, int role)
+{
+	if (m_headerDataSubModel)
+		return m_headerDataSubModel->setHeaderData(section, orientation, value, role);
+	else
+		return QAbstractItemModel::setHeaderData(section, orientation, value, role);
+}
+
+bool Utils::ModelListModel::setItemData(const QModelIndex& index, const QMap<int, QVariant>& roles)
+{
+	Utils::ModelListModel::SubModelIndex smi = mapToSource(index);
+	return smi.first->setItemData(smi.second, roles);
+}
+
+void Utils::ModelListModel::sort(int column, Qt::SortOrder order)
+{
+	if (!m_flat)
+	{
+		foreach (QAbstractItemModel* subModel, m_subModels)
+			subModel->sort(column, order);
+		return;
+	}
+	if (m_sortColumn == column && m_sortOrder == order)
+		return;
+	beginResetModel();
+	m_pendingDataChanges.clear(); //see setFlat
+	m_sortColumn = qMax(column, -1);
+	m_sortOrder = order;
+	rebuildMergedOrder();
+	endResetModel();
+}
+
+void Utils::ModelListModel::revert()
+{
+	m_metaModel->revert();
+	foreach (QAbstractItemModel* subModel, m_subModels)
+		subModel->revert();
+}
+
+bool Utils::ModelListModel::submit()
+{
+	bool success = m_metaModel->submit();
+	foreach (QAbstractItemModel* subModel, m_subModels)
+		success &= subModel->submit();
+	return success;
+}
+
+//END QAbstractItemModel reimplementation
+
+//BEGIN event propagation for submodels
+//WARNING: This stuff is largely untested. Only insertion/removal of rows in submodels is known to work.
+//NOTE: Before a structural change is forwarded, pending data changes of the same submodel have to be flushed, because their positions are not valid afterwards.
+
+void Utils::ModelListModel::handleColumnsAboutToBeInserted(const QModelIndex& parent, int start, int end)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	flushDataChanges(senderModel);
+	invalidateDataCache(existingNodeFor(senderModel, parent), 0, INT_MAX, start, INT_MAX);
+	if (m_flat)
+		beginResetModel(); //the columns of the root level are shared by all submodels
+	else
+		beginInsertColumns(mapFromSource(qMakePair(senderModel, parent)), start, end);
+}
+
+void Utils::ModelListModel::handleColumnsAboutToBeMoved(const QModelIndex& sourceParent, int sourceStart, int sourceEnd, const QModelIndex& destinationParent, int destinationColumn)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	flushDataChanges(senderModel);
+	invalidateMovedData(senderModel, sourceParent, sourceStart, destinationParent, destinationColumn, Qt::Horizontal);
+	if (moveForwarding(sourceParent, destinationParent, Qt::Horizontal) == ForwardReset)
+		beginResetModel(); //see handleColumnsAboutToBeInserted
+	else
+		beginMoveColumns(mapFromSource(qMakePair(senderModel, sourceParent)), sourceStart, sourceEnd, mapFromSource(qMakePair(senderModel, destinationParent)), destinationColumn);
+}
+
+void Utils::ModelListModel::handleColumnsAboutToBeRemoved(const QModelIndex& parent, int start, int end)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	flushDataChanges(senderModel);
+	invalidateDataCache(existingNodeFor(senderModel, parent), 0, INT_MAX, start, INT_MAX);
+	if (m_flat)
+		beginResetModel(); //see above
+	else
+		beginRemoveColumns(mapFromSource(qMakePair(senderModel, parent)), start, end);
+}
+
+void Utils::ModelListModel::handleColumnsInserted(const QModelIndex& parent, int start, int end)
+{
+	Q_UNUSED(end)
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	rekeyNodes(senderModel, parent, start, Qt::Horizontal); //before the persistent indexes of this model are updated
+	if (m_flat)
+	{
+		m_flatColumnCount = subModelColumnCount();
+		rebuildMergedOrder();
+		endResetModel();
+	}
+	else
+		endInsertColumns();
+	updateSearchIndex(senderModel); //the first column may have been replaced
+}
+
+void Utils::ModelListModel::handleColumnsMoved(const QModelIndex& sourceParent, int sourceStart, int sourceEnd, const QModelIndex& destinationParent, int destinationColumn)
+{
+	Q_UNUSED(sourceEnd)
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	rekeyMovedNodes(senderModel, sourceParent, sourceStart, destinationParent, destinationColumn, Qt::Horizontal); //before the persistent indexes of this model are updated
+	if (moveForwarding(sourceParent, destinationParent, Qt::Horizontal) == ForwardReset)
+	{
+		m_flatColumnCount = subModelColumnCount();
+		rebuildMergedOrder(); //the sort column may have moved
+		endResetModel();
+	}
+	else
+		endMoveColumns();
+	if (!sourceParent.isValid() || !destinationParent.isValid())
+		updateSearchIndex(senderModel); //the first column may have been replaced
+}
+
+void Utils::ModelListModel::handleColumnsRemoved(const QModelIndex& parent, int start, int end)
+{
+	Q_UNUSED(end)
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	rekeyNodes(senderModel, parent, start, Qt::Horizontal); //see above
+	if (m_flat)
+	{
+		m_flatColumnCount = subModelColumnCount();
+		rebuildMergedOrder();
+		endResetModel();
+	}
+	else
+		endRemoveColumns();
+	updateSearchIndex(senderModel); //see above
+}
+
+void Utils::ModelListModel::handleDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	if (!senderModel || !topLeft.isValid() || !bottomRight.isValid())
+		return;
+	//the cache has to be updated now, even if the signal is forwarded later
+	invalidateDataCache(existingNodeFor(senderModel, topLeft.parent()), topLeft.row(), bottomRight.row(), topLeft.column(), bottomRight.column());
+	SearchIndex* searchIndex = m_searchIndexes.value(senderModel);
+	if (searchIndex && !topLeft.parent().isValid() && topLeft.column() == 0)
+	{
+		const QVector<QString> texts = searchTexts(senderModel, topLeft.row(), bottomRight.row());
+		for (int i = 0; i < texts.count(); ++i)
+			searchIndex->setText(topLeft.row() + i, texts[i]);
+		if (searchIndex->needsRebuild() && !m_searchBuilds.contains(senderModel))
+			buildSearchIndex(senderModel, false);
+	}
+	//in sorted flat mode, the changed rows may have to be moved
+	if (isMerged() && !topLeft.parent().isValid() && topLeft.column() <= m_sortColumn && m_sortColumn <= bottomRight.column())
+	{
+		flushDataChanges(senderModel); //the pending changes refer to the old positions
+		const int subModelIndex = m_subModelRows.value(senderModel);
+		QVector<QVariant> keys(bottomRight.row() - topLeft.row() + 1);
+		int changedKeys = 0;
+		for (int i = 0; i < keys.count(); ++i)
+		{
+			keys[i] = sortKey(senderModel, topLeft.row() + i);
+			if (keys[i] != m_mergedOrder.key(subModelIndex, topLeft.row() + i))
+				++changedKeys;
+		}
+		if (changedKeys > MergedOrder::MaxRuns)
+		{
+			//too many single moves: sort the changed rows again, and merge them with the others
+			beginLayoutChange(0);
+			m_mergedOrder.updateKeys(subModelIndex, topLeft.row(), keys);
+			endLayoutChange();
+		}
+		else
+		{
+			for (int i = 0; i < keys.count(); ++i)
+			{
+				const int sourceRow = topLeft.row() + i;
+				const int row = m_mergedOrder.rowOf(subModelIndex, sourceRow);
+				const int destination = m_mergedOrder.insertionRow(subModelIndex, sourceRow, keys[i]);
+				if (row == -1)
+					continue;
+				if (destination == row || destination == row + 1)
+					m_mergedOrder.setKey(subModelIndex, sourceRow, keys[i]); //stays in place
+				else
+				{
+					beginMoveRows(QModelIndex(), row, row, QModelIndex(), destination);
+					m_mergedOrder.move(row, destination, keys[i]);
+					endMoveRows();
+				}
+			}
+		}
+	}
+	//only changes on the root level of the submodels are merged (which is where they typically happen)
+	if (topLeft.parent().isValid())
+	{
+		emit dataChanged(mapFromSource(qMakePair(senderModel, topLeft)), mapFromSource(qMakePair(senderModel, bottomRight)));
+		return;
+	}
+	//merge with the pending changes of this submodel, if they overlap or touch (otherwise, the bounding rectangle could span far more than the changed cells, so the pending range is flushed instead)
+	const QRect range(QPoint(topLeft.column(), topLeft.row()), QPoint(bottomRight.column(), bottomRight.row()));
+	QHash<QAbstractItemModel*, QRect>::iterator it = m_pendingDataChanges.find(senderModel);
+	if (it != m_pendingDataChanges.end() && !it->adjusted(0, -1, 0, 1).intersects(range) && !it->adjusted(-1, 0, 1, 0).intersects(range))
+	{
+		flushDataChanges(senderModel);
+		it = m_pendingDataChanges.end();
+	}
+	if (it == m_pendingDataChanges.end())
+		m_pendingDataChanges.insert(senderModel, range);
+	else
+		*it = it->united(range);
+	if (!m_flushScheduled)
+	{
+		m_flushScheduled = true;
+		QMetaObject::invokeMethod(this, "flushPendingDataChanges", Qt::QueuedConnection);
+	}
+}
+
+void Utils::ModelListModel::flushPendingDataChanges()
+{
+	m_flushScheduled = false;
+	foreach (QAbstractItemModel* subModel, m_pendingDataChanges.keys())
+		flushDataChanges(subModel);
+}
+
+void Utils::ModelListModel::flushDataChanges(QAbstractItemModel* subModel)
+{
+	QHash<QAbstractItemModel*, QRect>::iterator it = m_pendingDataChanges.find(subModel);
+	if (it == m_pendingDataChanges.end())
+		return;
+	const QRect range = *it;
+	m_pendingDataChanges.erase(it);
+	if (isMerged())
+	{
+		//the changed rows are scattered, so announce the smallest range which contains all of them
+		const int subModelIndex = m_subModelRows.value(subModel);
+		int firstRow = INT_MAX, lastRow = -1;
+		for (int sourceRow = range.top(); sourceRow <= range.bottom(); ++sourceRow)
+		{
+			const int row = m_mergedOrder.rowOf(subModelIndex, sourceRow);
+			if (row != -1)
+			{
+				firstRow = qMin(firstRow, row);
+				lastRow = qMax(lastRow, row);
+			}
+		}
+		if (lastRow != -1)
+			emit dataChanged(index(firstRow, range.left()), index(lastRow, range.right()));
+		return;
+	}
+	const QModelIndex topLeft = subModel->index(range.top(), range.left());
+	const QModelIndex bottomRight = subModel->index(range.bottom(), range.right());
+	emit dataChanged(mapFromSource(qMakePair(subModel, topLeft)), mapFromSource(qMakePair(subModel, bottomRight)));
+}
+
+void Utils::ModelListModel::handleHeaderDataChanged(Qt::Orientation orientation, int first, int last) //NOTE: check sender() == m_headerDataSubModel
+{
+	if (sender() == m_headerDataSubModel)
+		emit headerDataChanged(orientation, first, last);
+}
+
+void Utils::ModelListModel::handleLayoutAboutToBeChanged()
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	if (!senderModel)
+		return;
+	flushDataChanges(senderModel);
+	beginLayoutChange(senderModel);
+}
+
+void Utils::ModelListModel::handleLayoutChanged()
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	if (!senderModel)
+		return;
+	rekeyNodes(senderModel);
+	invalidateDataCache(senderModel); //the rows have moved
+	if (isMerged())
+	{
+		const int subModelIndex = m_subModelRows.value(senderModel);
+		QVector<QVariant> keys(senderModel->rowCount());
+		for (int row = 0; row < keys.count(); ++row)
+			keys[row] = sortKey(senderModel, row);
+		m_mergedOrder.replaceSubModel(subModelIndex, keys);
+	}
+	updateSearchIndex(senderModel);
+	endLayoutChange();
+}
+
+void Utils::ModelListModel::handleModelAboutToBeReset()
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	if (!senderModel)
+		return;
+	m_pendingDataChanges.remove(senderModel); //the changed rows are removed anyway
+	invalidateDataCache(senderModel);
+	if (isMerged())
+	{
+		//the rows of the submodel are scattered over the whole model
+		beginResetModel();
+		m_pendingDataChanges.clear(); //see setFlat
+		return;
+	}
+	//forward this as a removal of all rows (which are inserted again in handleModelReset), so that the rest of the model is not affected
+	const int subModelIndex = m_subModelRows.value(senderModel);
+	const int count = m_rowOffsets.count(subModelIndex);
+	const int firstRow = m_flat ? rowOffset(senderModel) : 0;
+	if (count > 0)
+		beginRemoveRows(mapFromSource(qMakePair(senderModel, QModelIndex())), firstRow, firstRow + count - 1);
+	m_resettingSubModels.insert(senderModel); //the submodel still reports its old rows until it is reset
+	m_rowOffsets.add(subModelIndex, -count);
+	if (count > 0)
+		endRemoveRows();
+}
+
+void Utils::ModelListModel::handleModelReset()
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	if (!senderModel)
+		return;
+	rekeyNodes(senderModel); //recycles all nodes of this submodel except for the root node
+	const int subModelIndex = m_subModelRows.value(senderModel);
+	const int count = senderModel->rowCount();
+	if (isMerged())
+	{
+		m_rowOffsets.add(subModelIndex, count - m_rowOffsets.count(subModelIndex));
+		m_flatColumnCount = subModelColumnCount();
+		rebuildMergedOrder();
+		endResetModel();
+	}
+	else
+	{
+		const int firstRow = m_flat ? rowOffset(senderModel) : 0;
+		if (count > 0)
+			beginInsertRows(mapFromSource(qMakePair(senderModel, QModelIndex())), firstRow, firstRow + count - 1);
+		m_resettingSubModels.remove(senderModel);
+		m_rowOffsets.add(subModelIndex, count);
+		if (count > 0)
+			endInsertRows();
+		updateFlatColumnCount(); //the submodel may have a different column count after the reset
+	}
+	updateSearchIndex(senderModel);
+}
+
+void Utils::ModelListModel::handleRowsAboutToBeInserted(const QModelIndex& parent, int start, int end)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	flushDataChanges(senderModel);
+	invalidateDataCache(existingNodeFor(senderModel, parent), start, INT_MAX, 0, INT_MAX); //these rows are moved
+	if (isMerged() && !parent.isValid())
+		return; //the positions of the new rows are not known before their data is available (see handleRowsInserted)
+	const int offset = (m_flat && !parent.isValid()) ? rowOffset(senderModel) : 0;
+	beginInsertRows(mapFromSource(qMakePair(senderModel, parent)), start + offset, end + offset);
+}
+
+void Utils::ModelListModel::handleRowsAboutToBeMoved(const QModelIndex& sourceParent, int sourceStart, int sourceEnd, const QModelIndex& destinationParent, int destinationRow)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	flushDataChanges(senderModel);
+	invalidateMovedData(senderModel, sourceParent, sourceStart, destinationParent, destinationRow, Qt::Vertical);
+	switch (moveForwarding(sourceParent, destinationParent, Qt::Vertical))
+	{
+		case ForwardLayoutChange:
+			handleLayoutAboutToBeChanged();
+			break;
+		case ForwardReset:
+			beginResetModel();
+			m_pendingDataChanges.clear(); //see setFlat
+			break;
+		case ForwardMove:
+		{
+			const int sourceOffset = (m_flat && !sourceParent.isValid()) ? rowOffset(senderModel) : 0;
+			const int destinationOffset = (m_flat && !destinationParent.isValid()) ? rowOffset(senderModel) : 0;
+			beginMoveRows(mapFromSource(qMakePair(senderModel, sourceParent)), sourceStart + sourceOffset, sourceEnd + sourceOffset, mapFromSource(qMakePair(senderModel, destinationParent)), destinationRow + destinationOffset);
+			break;
+		}
+	}
+}
+
+void Utils::ModelListModel::handleRowsAboutToBeRemoved(const QModelIndex& parent, int start, int end)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	flushDataChanges(senderModel);
+	invalidateDataCache(existingNodeFor(senderModel, parent), start, INT_MAX, 0, INT_MAX); //the children of the removed rows are dropped when their nodes are recycled
+	SearchIndex* searchIndex = m_searchIndexes.value(senderModel);
+	if (searchIndex && !parent.isValid())
+	{
+		searchIndex->removeRows(start, end);
+		if (searchIndex->needsRebuild() && !m_searchBuilds.contains(senderModel))
+			buildSearchIndex(senderModel, false);
+	}
+	if (isMerged() && !parent.isValid())
+	{
+		//the removed rows are scattered, so each run of adjacent rows is removed at once, from the back (while the remaining rows still have their old source rows)
+		const int subModelIndex = m_subModelRows.value(senderModel);
+		QVector<int> rows;
+		rows.reserve(end - start + 1);
+		for (int sourceRow = start; sourceRow <= end; ++sourceRow)
+		{
+			const int row = m_mergedOrder.rowOf(subModelIndex, sourceRow);
+			if (row != -1)
+				rows << row;
+		}
+		std::sort(rows.begin(), rows.end());
+		QVector<QPair<int, int> > runs; //first and last row
+		foreach (int row, rows)
+		{
+			if (!runs.isEmpty() && runs.last().second == row - 1)
+				runs.last().second = row;
+			else
+				runs << qMakePair(row, row);
+		}
+		if (runs.count() > MergedOrder::MaxRuns && rows.count() == end - start + 1)
+		{
+			//too many runs: move the removed rows to the end with a layout change, and remove them there
+			beginLayoutChange(0);
+			m_mergedOrder.moveToTail(subModelIndex, start, rows.count());
+			endLayoutChange();
+			beginRemoveRows(QModelIndex(), m_mergedOrder.count() - rows.count(), m_mergedOrder.count() - 1);
+			m_mergedOrder.removeTail();
+			endRemoveRows();
+			return;
+		}
+		for (int i = runs.count() - 1; i >= 0; --i)
+		{
+			beginRemoveRows(QModelIndex(), runs[i].first, runs[i].second);
+			m_mergedOrder.remove(runs[i].first, runs[i].second - runs[i].first + 1);
+			endRemoveRows();
+		}
+		return;
+	}
+	const int offset = (m_flat && !parent.isValid()) ? rowOffset(senderModel) : 0;
+	beginRemoveRows(mapFromSource(qMakePair(senderModel, parent)), start + offset, end + offset);
+}
+
+void Utils::ModelListModel::handleRowsInserted(const QModelIndex& parent, int start, int end)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	rekeyNodes(senderModel, parent, start, Qt::Vertical); //before the persistent indexes of this model are updated
+	if (!parent.isValid())
+		m_rowOffsets.add(m_subModelRows.value(senderModel, -1), end - start + 1);
+	if (isMerged() && !parent.isValid())
+	{
+		//shift the source rows of the existing rows first, so that the model is consistent after each insertion
+		const int subModelIndex = m_subModelRows.value(senderModel);
+		QVector<QVariant> keys(end - start + 1);
+		for (int i = 0; i < keys.count(); ++i)
+			keys[i] = sortKey(senderModel, start + i);
+		m_mergedOrder.insertSourceRows(subModelIndex, start, keys);
+		QVector<int> sortedSourceRows;
+		const QVector<MergedOrder::Run> runs = m_mergedOrder.insertionRuns(subModelIndex, start, keys.count(), sortedSourceRows);
+		if (runs.count() > MergedOrder::MaxRuns)
+		{
+			//too many runs: insert the new rows at the end, and move them to their places with a layout change
+			const int row = m_mergedOrder.count();
+			beginInsertRows(QModelIndex(), row, row + keys.count() - 1);
+			m_mergedOrder.appendToTail(subModelIndex, start, keys.count());
+			endInsertRows();
+			beginLayoutChange(0);
+			m_mergedOrder.mergeTail();
+			endLayoutChange();
+		}
+		else
+		{
+			foreach (const MergedOrder::Run& run, runs)
+			{
+				beginInsertRows(QModelIndex(), run.row, run.row + run.count - 1);
+				m_mergedOrder.insert(run, subModelIndex, sortedSourceRows);
+				endInsertRows();
+			}
+		}
+	}
+	else
+		endInsertRows();
+	SearchIndex* searchIndex = m_searchIndexes.value(senderModel);
+	if (searchIndex && !parent.isValid())
+		searchIndex->insertRows(start, searchTexts(senderModel, start, end));
+}
+
+void Utils::ModelListModel::handleRowsMoved(const QModelIndex& sourceParent, int sourceStart, int sourceEnd, const QModelIndex& destinationParent, int destinationRow)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	const MoveForwarding forwarding = moveForwarding(sourceParent, destinationParent, Qt::Vertical);
+	if (forwarding == ForwardLayoutChange)
+	{
+		handleLayoutChanged(); //rekeys the nodes, and updates the merged order and the search index
+		return;
+	}
+	rekeyMovedNodes(senderModel, sourceParent, sourceStart, destinationParent, destinationRow, Qt::Vertical); //before the persistent indexes of this model are updated
+	//rows which move between the root level and another parent change the root-level row count of the submodel
+	const int count = sourceEnd - sourceStart + 1;
+	if (!sourceParent.isValid() && destinationParent.isValid())
+		m_rowOffsets.add(m_subModelRows.value(senderModel, -1), -count);
+	else if (sourceParent.isValid() && !destinationParent.isValid())
+		m_rowOffsets.add(m_subModelRows.value(senderModel, -1), count);
+	if (forwarding == ForwardReset)
+	{
+		rebuildMergedOrder();
+		endResetModel();
+	}
+	else
+		endMoveRows();
+	if (!sourceParent.isValid() || !destinationParent.isValid())
+		updateSearchIndex(senderModel); //the root-level rows have moved
+}
+
+void Utils::ModelListModel::handleRowsRemoved(const QModelIndex& parent, int start, int end)
+{
+	QAbstractItemModel* senderModel = safeModelCast(sender());
+	rekeyNodes(senderModel, parent, start, Qt::Vertical); //also recycles the nodes of the removed items
+	if (!parent.isValid())
+		m_rowOffsets.add(m_subModelRows.value(senderModel, -1), start - end - 1);
+	if (isMerged() && !parent.isValid())
+		m_mergedOrder.removeSourceRows(m_subModelRows.value(senderModel), start, end - start + 1); //the rows have already been removed in handleRowsAboutToBeRemoved
+	else
+		endRemoveRows();
+}
+
+void Utils::ModelListModel::handleSubModelDeleted(QObject* model)
+{
+	removeSubModel(reinterpret_cast<QAbstractItemModel*>(model));
+}
+
+//END event propagation for submodels
+
+//BEGIN row offsets for flat mode
+
+Utils::ModelListModel::RowOffsets::RowOffsets()
+	: m_tree(1, 0) //m_tree[0] is not used
+	, m_total(0)
+{
+}
+
+void Utils::ModelListModel::RowOffsets::append(int count)
+{
+	m_counts << count;
+	m_total += count;
+	//the new node covers the counts in (i - lowbit(i), i]; all but the last one are already summed up in the nodes below
+	const int i = m_counts.count();
+	m_tree << count + offset(i - 1) - offset(i - (i & -i));
+}
+
+void Utils::ModelListModel::RowOffsets::removeAt(int index)
+{
+	m_total -= m_counts[index];
+	m_counts.remove(index);
+	rebuild();
+}
+
+void Utils::ModelListModel::RowOffsets::add(int index, int delta)
+{
+	if (index < 0 || index >= m_counts.count())
+		return;
+	m_counts[index] += delta;
+	m_total += delta;
+	for (int i = index + 1; i < m_tree.count(); i += i & -i)
+		m_tree[i] += delta;
+}
+
+int Utils::ModelListModel::RowOffsets::count(int index) const
+{
+	return m_counts.value(index);
+}
+
+int Utils::ModelListModel::RowOffsets::offset(int index) const
+{
+	int sum = 0;
+	for (int i = index; i > 0; i -= i & -i)
+		sum += m_tree[i];
+	return sum;
+}
+
+int Utils::ModelListModel::RowOffsets::total() const
+{
+	return m_total;
+}
+
+int Utils::ModelListModel::RowOffsets::indexOf(int row) const
+{
+	if (row < 0 || row >= m_total)
+		return -1;
+	//descend the implicit tree: find the largest position whose prefix sum is not greater than row
+	const int size = m_counts.count();
+	int step = 1;
+	while (step * 2 <= size)
+		step *= 2;
+	int position = 0;
+	for (; step > 0; step /= 2)
+	{
+		if (position + step <= size && m_tree[position + step] <= row)
+		{
+			position += step;
+			row -= m_tree[position];
+		}
+	}
+	return position; //the prefix sum up to the count at this index is greater than row
+}
+
+void Utils::ModelListModel::RowOffsets::rebuild()
+{
+	const int size = m_counts.count();
+	m_tree.fill(0, size + 1);
+	for (int i = 1; i <= size; ++i)
+	{
+		m_tree[i] += m_counts[i - 1];
+		const int parent = i + (i & -i);
+		if (parent <= size)
+			m_tree[parent] += m_tree[i];
+	}
+}
+
+//END row offsets for flat mode
+
+//BEGIN search index
+
+Utils::ModelListModel::SearchIndex::SearchIndex()
+	: m_indexed(false)
+	, m_building(false)
+	, m_staleItems(0)
+{
+}
+
+void Utils::ModelListModel::SearchIndex::setTexts(const QVector<QString>& texts)
+{
+	//keep the items of unchanged texts (e.g. after a layout change), so that their postings stay valid
+	QMultiHash<QString, int> itemsByText;
+	foreach (int item, m_rowItems)
+		itemsByText.insert(m_texts[item], item);
+	QVector<int> rowItems(texts.count(), -1);
+	for (int row = 0; row < texts.count(); ++row)
+	{
+		QMultiHash<QString, int>::iterator it = itemsByText.find(texts[row]);
+		if (it != itemsByText.end())
+		{
+			rowItems[row] = it.value();
+			itemsByText.erase(it);
+		}
+	}
+	//release the items of the vanished texts first, so that they can be reused for the new texts
+	QMultiHash<QString, int>::const_iterator it = itemsByText.constBegin(), end = itemsByText.constEnd();
+	for (; it != end; ++it)
+		releaseItem(it.value());
+	for (int row = 0; row < texts.count(); ++row)
+	{
+		if (rowItems[row] == -1)
+		{
+			rowItems[row] = allocateItem(texts[row]);
+			indexItem(rowItems[row]);
+		}
+	}
+	m_rowItems = rowItems;
+	renumberRows(0);
+}
+
+void Utils::ModelListModel::SearchIndex::insertRows(int start, const QVector<QString>& texts)
+{
+	m_rowItems.insert(start, texts.count(), -1);
+	for (int i = 0; i < texts.count(); ++i)
+	{
+		const int item = allocateItem(texts[i]);
+		m_rowItems[start + i] = item;
+		indexItem(item);
+	}
+	renumberRows(start);
+}
+
+void Utils::ModelListModel::SearchIndex::removeRows(int start, int end)
+{
+	for (int row = start; row <= end; ++row)
+		releaseItem(m_rowItems[row]);
+	m_rowItems.remove(start, end - start + 1);
+	renumberRows(start);
+}
+
+void Utils::ModelListModel::SearchIndex::setText(int row, const QString& text)
+{
+	const int item = m_rowItems.value(row, -1);
+	if (item == -1 || m_texts[item] == text)
+		return;
+	m_texts[item] = text;
+	++m_staleItems;
+	indexItem(item);
+}
+
+QList<int> Utils::ModelListModel::SearchIndex::match(const QString& text) const
+{
+	QList<int> rows;
+	const QVector<quint64> textTrigrams = trigrams(text);
+	if (!m_indexed || textTrigrams.isEmpty())
+	{
+		//no index available before the first build has finished, or the text is too short to use it
+		for (int row = 0; row < m_rowItems.count(); ++row)
+			if (m_texts[m_rowItems[row]].contains(text))
+				rows << row;
+		return rows;
+	}
+	//check the items which contain the least common trigram of the text
+	const QVector<int>* candidates = 0;
+	foreach (quint64 trigram, textTrigrams)
+	{
+		Postings::const_iterator it = m_postings.constFind(trigram);
+		if (it == m_postings.constEnd())
+			return rows; //no text contains this trigram
+		if (!candidates || it->count() < candidates->count())
+			candidates = &it.value();
+	}
+	foreach (int item, *candidates)
+	{
+		const int row = m_itemRows[item];
+		if (row != -1 && m_texts[item].contains(text))
+			rows << row;
+	}
+	//an item is listed twice if its text has been changed or if it has been reused
+	std::sort(rows.begin(), rows.end());
+	rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+	return rows;
+}
+
+QVector<QString> Utils::ModelListModel::SearchIndex::beginBuild()
+{
+	//the old postings (if any) stay in use until endBuild()
+	m_building = true;
+	m_unindexedItems.clear();
+	m_staleItems = 0;
+	return m_texts;
+}
+
+void Utils::ModelListModel::SearchIndex::endBuild(const Utils::ModelListModel::SearchIndex::Postings& postings)
+{
+	m_postings = postings;
+	m_indexed = true;
+	m_building = false;
+	foreach (int item, m_unindexedItems)
+		addPostings(item);
+	m_unindexedItems.clear();
+}
+
+Utils::ModelListModel::SearchIndex::Postings Utils::ModelListModel::SearchIndex::buildPostings(const QVector<QString>& texts)
+{
+	//NOTE: This is executed in a background thread.
+	Postings postings;
+	for (int item = 0; item < texts.count(); ++item)
+		foreach (quint64 trigram, trigrams(texts[item]))
+			postings[trigram] << item;
+	return postings;
+}
+
+bool Utils::ModelListModel::SearchIndex::needsRebuild() const
+{
+	//rebuild when the outdated entries in the postings could slow down the search noticeably
+	return m_indexed && !m_building && m_staleItems > qMax(m_rowItems.count(), 1024);
+}
+
+QVector<quint64> Utils::ModelListModel::SearchIndex::trigrams(const QString& text)
+{
+	QVector<quint64> result;
+	const int count = text.size() - 2;
+	if (count <= 0)
+		return result;
+	result.reserve(count);
+	const ushort* characters = text.utf16();
+	for (int i = 0; i < count; ++i)
+		result << ((quint64(characters[i]) << 32) | (quint64(characters[i + 1]) << 16) | quint64(characters[i + 2]));
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+	return result;
+}
+
+int Utils::ModelListModel::SearchIndex::allocateItem(const QString& text)
+{
+	int item;
+	if (m_freeItems.isEmpty())
+	{
+		item = m_texts.count();
+		m_texts << text;
+		m_itemRows << -1;
+	}
+	else
+	{
+		item = m_freeItems.last();
+		m_freeItems.pop_back();
+		m_texts[item] = text;
+	}
+	return item;
+}
+
+void Utils::ModelListModel::SearchIndex::releaseItem(int item)
+{
+	m_texts[item] = QString();
+	m_itemRows[item] = -1;
+	m_freeItems << item;
+	++m_staleItems;
+}
+
+void Utils::ModelListModel::SearchIndex::indexItem(int item)
+{
+	//during a build, the item goes into the old postings (which answer the queries until then) as well as into the new ones
+	if (m_indexed)
+		addPostings(item);
+	if (!m_indexed || m_building)
+		m_unindexedItems << item;
+}
+
+void Utils::ModelListModel::SearchIndex::addPostings(int item)
+{
+	foreach (quint64 trigram, trigrams(m_texts[item]))
+		m_postings[trigram] << item;
+}
+
+void Utils::ModelListModel::SearchIndex::renumberRows(int firstRow)
+{
+	for (int row = firstRow; row < m_rowItems.count(); ++row)
+		m_itemRows[m_rowItems[row]] = row;
+}
+
+//END search index
+
+//BEGIN merged order for sorted flat mode
+
+Utils::ModelListModel::MergedOrder::MergedOrder()
+	: m_order(Qt::AscendingOrder)
+	, m_tailSubModel(-1)
+	, m_tailSourceRow(0)
+	, m_tailCount(0)
+{
+}
+
+void Utils::ModelListModel::MergedOrder::clear()
+{
+	m_entries.clear();
+	m_keys.clear();
+	m_tailCount = 0;
+}
+
+void Utils::ModelListModel::MergedOrder::build(const QVector<QVector<QVariant> >& keys, Qt::SortOrder order)
+{
+	m_keys = keys;
+	m_order = order;
+	m_tailCount = 0;
+	//sort the rows of each submodel
+	const int subModelCount = keys.count();
+	QVector<QVector<Entry> > runs(subModelCount);
+	int totalCount = 0;
+	EntryLessThan lessThan = { this, false };
+	for (int subModel = 0; subModel < subModelCount; ++subModel)
+	{
+		QVector<Entry>& run = runs[subModel];
+		run.resize(keys[subModel].count());
+		for (int row = 0; row < run.count(); ++row)
+		{
+			run[row].subModel = subModel;
+			run[row].sourceRow = row;
+		}
+		std::sort(run.begin(), run.end(), lessThan);
+		totalCount += run.count();
+	}
+	//k-way merge: the heap contains the first remaining entry of each run (with the smallest entry on top, hence the inverted comparison)
+	EntryLessThan greaterThan = { this, true };
+	QVector<int> positions(subModelCount, 0);
+	QVector<Entry> heap;
+	heap.reserve(subModelCount);
+	for (int subModel = 0; subModel < subModelCount; ++subModel)
+		if (!runs[subModel].isEmpty())
+			heap << runs[subModel][0];
+	std::make_heap(heap.begin(), heap.end(), greaterThan);
+	m_entries.clear();
+	m_entries.reserve(totalCount);
+	while (!heap.isEmpty())
+	{
+		std::pop_heap(heap.begin(), heap.end(), greaterThan);
+		const Entry entry = heap.last();
+		m_entries << entry;
+		const int next = ++positions[entry.subModel];
+		if (next < runs[entry.subModel].count())
+		{
+			heap.last() = runs[entry.subModel][next];
+			std::push_heap(heap.begin(), heap.end(), greaterThan);
+		}
+		else
+			heap.pop_back();
+	}
+}
+
+int Utils::ModelListModel::MergedOrder::count() const
+{
+	return m_entries.count();
+}
+
+int Utils::ModelListModel::MergedOrder::subModelAt(int row) const
+{
+	return m_entries[row].subModel;
+}
+
+int Utils::ModelListModel::MergedOrder::sourceRowAt(int row) const
+{
+	return m_entries[row].sourceRow;
+}
+
+const QVariant& Utils::ModelListModel::MergedOrder::key(int subModel, int sourceRow) const
+{
+	return m_keys[subModel][sourceRow];
+}
+
+int Utils::ModelListModel::MergedOrder::sortedCount() const
+{
+	return m_entries.count() - m_tailCount;
+}
+
+int Utils::ModelListModel::MergedOrder::rowOf(int subModel, int sourceRow) const
+{
+	if (subModel < 0 || subModel >= m_keys.count() || sourceRow < 0 || sourceRow >= m_keys[subModel].count())
+		return -1;
+	//the tail is in the order of its source rows
+	if (subModel == m_tailSubModel && sourceRow >= m_tailSourceRow && sourceRow < m_tailSourceRow + m_tailCount)
+		return sortedCount() + sourceRow - m_tailSourceRow;
+	const int row = insertionRow(subModel, sourceRow, m_keys[subModel][sourceRow]);
+	if (row == sortedCount() || m_entries[row].subModel != subModel || m_entries[row].sourceRow != sourceRow)
+		return -1;
+	return row;
+}
+
+int Utils::ModelListModel::MergedOrder::insertionRow(int subModel, int sourceRow, const QVariant& key) const
+{
+	//binary search for the first entry which is not less than the given one
+	const Entry entry = { subModel, sourceRow };
+	int first = 0, last = sortedCount();
+	while (first < last)
+	{
+		const int middle = first + (last - first) / 2;
+		const Entry& other = m_entries[middle];
+		if (entryLessThan(other, m_keys[other.subModel][other.sourceRow], entry, key))
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	return first;
+}
+
+void Utils::ModelListModel::MergedOrder::remove(int row, int count)
+{
+	m_entries.remove(row, count);
+}
+
+void Utils::ModelListModel::MergedOrder::move(int row, int destination, const QVariant& key)
+{
+	const Entry entry = m_entries[row];
+	m_entries.remove(row);
+	m_keys[entry.subModel][entry.sourceRow] = key;
+	m_entries.insert(destination > row ? destination - 1 : destination, entry);
+}
+
+void Utils::ModelListModel::MergedOrder::setKey(int subModel, int sourceRow, const QVariant& key)
+{
+	m_keys[subModel][sourceRow] = key;
+}
+
+void Utils::ModelListModel::MergedOrder::updateKeys(int subModel, int start, const QVector<QVariant>& keys)
+{
+	QVector<QVariant>& subModelKeys = m_keys[subModel];
+	for (int i = 0; i < keys.count(); ++i)
+		subModelKeys[start + i] = keys[i];
+	resort(subModel, start, keys.count());
+}
+
+void Utils::ModelListModel::MergedOrder::replaceSubModel(int subModel, const QVector<QVariant>& keys)
+{
+	m_keys[subModel] = keys;
+	resort(subModel, 0, keys.count());
+}
+
+void Utils::ModelListModel::MergedOrder::resort(int subModel, int start, int count)
+{
+	Q_ASSERT(m_tailCount == 0);
+	EntryLessThan lessThan = { this, false };
+	QVector<Entry> run(count);
+	for (int i = 0; i < count; ++i)
+	{
+		run[i].subModel = subModel;
+		run[i].sourceRow = start + i;
+	}
+	std::sort(run.begin(), run.end(), lessThan);
+	//the other entries are still sorted
+	const int end = start + count;
+	QVector<Entry> others;
+	others.reserve(m_entries.count());
+	foreach (const Entry& entry, m_entries)
+		if (entry.subModel != subModel || entry.sourceRow < start || entry.sourceRow >= end)
+			others << entry;
+	m_entries.resize(others.count() + run.count());
+	std::merge(others.constBegin(), others.constEnd(), run.constBegin(), run.constEnd(), m_entries.begin(), lessThan);
+}
+
+void Utils::ModelListModel::MergedOrder::insertSourceRows(int subModel, int start, const QVector<QVariant>& keys)
+{
+	const int count = keys.count();
+	QVector<QVariant>& subModelKeys = m_keys[subModel];
+	subModelKeys.insert(start, count, QVariant());
+	for (int i = 0; i < count; ++i)
+		subModelKeys[start + i] = keys[i];
+	for (int row = 0; row < m_entries.count(); ++row)
+	{
+		Entry& entry = m_entries[row];
+		if (entry.subModel == subModel && entry.sourceRow >= start)
+			entry.sourceRow += count;
+	}
+}
+
+void Utils::ModelListModel::MergedOrder::removeSourceRows(int subModel, int start, int count)
+{
+	m_keys[subModel].remove(start, count);
+	for (int row = 0; row < m_entries.count(); ++row)
+	{
+		Entry& entry = m_entries[row];
+		if (entry.subModel == subModel && entry.sourceRow >= start)
+			entry.sourceRow -= count;
+	}
+}
+
+QVector<Utils::ModelListModel::MergedOrder::Run> Utils::ModelListModel::MergedOrder::insertionRuns(int subModel, int start, int count, QVector<int>& sortedSourceRows) const
+{
+	EntryLessThan lessThan = { this, false };
+	QVector<Entry> entries(count);
+	for (int i = 0; i < count; ++i)
+	{
+		entries[i].subModel = subModel;
+		entries[i].sourceRow = start + i;
+	}
+	std::sort(entries.begin(), entries.end(), lessThan);
+	//new rows which belong in front of the same existing row form one run (the row of each run includes the rows of the runs before it)
+	sortedSourceRows.resize(count);
+	QVector<Run> runs;
+	int lastInsertionRow = -1;
+	for (int i = 0; i < count; ++i)
+	{
+		const Entry& entry = entries[i];
+		sortedSourceRows[i] = entry.sourceRow;
+		const int row = insertionRow(subModel, entry.sourceRow, m_keys[subModel][entry.sourceRow]);
+		if (row == lastInsertionRow)
+			++runs.last().count;
+		else
+		{
+			const Run run = { row + i, i, 1 };
+			runs << run;
+			lastInsertionRow = row;
+		}
+	}
+	return runs;
+}
+
+void Utils::ModelListModel::MergedOrder::insert(const Run& run, int subModel, const QVector<int>& sortedSourceRows)
+{
+	m_entries.insert(run.row, run.count, Entry());
+	for (int i = 0; i < run.count; ++i)
+	{
+		Entry& entry = m_entries[run.row + i];
+		entry.subModel = subModel;
+		entry.sourceRow = sortedSourceRows[run.first + i];
+	}
+}
+
+void Utils::ModelListModel::MergedOrder::appendToTail(int subModel, int start, int count)
+{
+	Q_ASSERT(m_tailCount == 0);
+	const int row = m_entries.count();
+	m_entries.resize(row + count);
+	for (int i = 0; i < count; ++i)
+	{
+		m_entries[row + i].subModel = subModel;
+		m_entries[row + i].sourceRow = start + i;
+	}
+	m_tailSubModel = subModel;
+	m_tailSourceRow = start;
+	m_tailCount = count;
+}
+
+void Utils::ModelListModel::MergedOrder::moveToTail(int subModel, int start, int count)
+{
+	Q_ASSERT(m_tailCount == 0);
+	//move the other entries to the front (in place, and without changing their order)
+	const int end = start + count;
+	int row = 0;
+	for (int i = 0; i < m_entries.count(); ++i)
+	{
+		const Entry entry = m_entries[i];
+		if (entry.subModel != subModel || entry.sourceRow < start || entry.sourceRow >= end)
+			m_entries[row++] = entry;
+	}
+	Q_ASSERT(row == m_entries.count() - count);
+	for (int i = 0; i < count; ++i)
+	{
+		m_entries[row + i].subModel = subModel;
+		m_entries[row + i].sourceRow = start + i;
+	}
+	m_tailSubModel = subModel;
+	m_tailSourceRow = start;
+	m_tailCount = count;
+}
+
+void Utils::ModelListModel::MergedOrder::mergeTail()
+{
+	EntryLessThan lessThan = { this, false };
+	const QVector<Entry>::iterator tail = m_entries.begin() + sortedCount();
+	std::sort(tail, m_entries.end(), lessThan);
+	std::inplace_merge(m_entries.begin(), tail, m_entries.end(), lessThan);
+	m_tailCount = 0;
+}
+
+void Utils::ModelListModel::MergedOrder::removeTail()
+{
+	m_entries.resize(sortedCount());
+	m_tailCount = 0;
+}
+
+bool Utils::ModelListModel::MergedOrder::lessThan(const QVariant& left, const QVariant& right)
+{
+	//same rules as in QSortFilterProxyModel::lessThan, but made a strict weak ordering (which the merge and the binary searches rely on): invalid values are sorted last, values of different types are ordered by type, and NaN is sorted after all numbers
+	const bool leftValid = left.isValid(), rightValid = right.isValid();
+	if (!leftValid || !rightValid)
+		return leftValid && !rightValid;
+	if (left.userType() != right.userType())
+		return left.userType() < right.userType();
+	switch (left.userType())
+	{
+		case QVariant::Int:
+			return left.toInt() < right.toInt();
+		case QVariant::UInt:
+			return left.toUInt() < right.toUInt();
+		case QVariant::LongLong:
+			return left.toLongLong() < right.toLongLong();
+		case QVariant::ULongLong:
+			return left.toULongLong() < right.toULongLong();
+		case QMetaType::Float:
+		case QVariant::Double:
+		{
+			const double leftValue = left.toDouble(), rightValue = right.toDouble();
+			if (qIsNaN(leftValue) || qIsNaN(rightValue))
+				return !qIsNaN(leftValue) && qIsNaN(rightValue);
+			return leftValue < rightValue;
+		}
+		case QVariant::Char:
+			return left.toChar() < right.toChar();
+		case QVariant::Date:
+			return left.toDate() < right.toDate();
+		case QVariant::Time:
+			return left.toTime() < right.toTime();
+		case QVariant::DateTime:
+			return left.toDateTime() < right.toDateTime();
+		default:
+			return QString::compare(left.toString(), right.toString()) < 0;
+	}
+}
+
+bool Utils::ModelListModel::MergedOrder::entryLessThan(const Entry& left, const QVariant& leftKey, const Entry& right, const QVariant& rightKey) const
+{
+	//invalid keys (e.g. of rows without data in the sort column) are sorted last in both orders
+	if (leftKey.isValid() != rightKey.isValid())
+		return leftKey.isValid();
+	if (m_order == Qt::AscendingOrder ? lessThan(leftKey, rightKey) : lessThan(rightKey, leftKey))
+		return true;
+	if (m_order == Qt::AscendingOrder ? lessThan(rightKey, leftKey) : lessThan(leftKey, rightKey))
+		return false;
+	//equal keys
+	if (left.subModel != right.subModel)
+		return left.subModel < right.subModel;
+	return left.sourceRow < right.sourceRow;
+}
+
+bool Utils::ModelListModel::MergedOrder::EntryLessThan::operator()(const Entry& left, const Entry& right) const
+{
+	const QVariant& leftKey = order->m_keys[left.subModel][left.sourceRow];
+	const QVariant& rightKey = order->m_keys[right.subModel][right.sourceRow];
+	if (inverted)
+		return order->entryLessThan(right, rightKey, left, leftKey);
+	return order->entryLessThan(left, leftKey, right, rightKey);
+}
+
+//END merged order for sorted flat mode
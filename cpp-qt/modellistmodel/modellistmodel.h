@@ -24,6 +24,14 @@
 #define UTILS_MODELLISTMODEL_H
 
 #include <QAbstractItemModel>
+#include <QCache>
+#include <QHash>
+#include <QMap>
+#include <QPersistentModelIndex>
+#include <QRect>
+#include <QSet>
+#include <QString>
+#include <QVector>
 class QStandardItem;
 class QStandardItemModel;
 
@@ -32,13 +40,22 @@ namespace Utils
 	/**
 	 * \class Utils::ModelListModel
 	 *
-	 * This tree-shaped proxy model contains multiple submodels. On its root level, it lists the available submodels, and the data of these models is displayed below these items ("below" in a hierarchical meaning, of course the submodel data is not on the root level). Only flat submodels are allowed (i.e., subclasses of QAbstractListModel and QAbstractTableModel).
+	 * This tree-shaped proxy model contains multiple submodels. On its root level, it lists the available submodels, and the data of these models is displayed below these items ("below" in a hierarchical meaning, of course the submodel data is not on the root level). The submodels may be flat (e.g. subclasses of QAbstractListModel and QAbstractTableModel) or tree-shaped.
+	 *
+	 * To find the submodel and the source parent of an index in O(1), the internal ID of each index refers to an entry of a node table. There is one node for the root level of each submodel, and one for each item of a tree-shaped submodel that has been used as a parent by a view (or by another user of this model). The nodes of a submodel are updated whenever rows or columns are inserted into or removed from this submodel; nodes whose item has been removed are recycled at this point.
 	 *
 	 * \warning This implementation does not honor all possible properties of the submodels. Most notably, the following virtual methods are not reimplemented in this ModelListModel:
-	 * \li incremental population: QAbstractItemModel::canFetchMore, QAbstractItemModel::fetchMore
 	 * \li drag/drop and MIME data: QAbstractItemModel::dropMimeData, QAbstractItemModel::mimeData, QAbstractItemModel::mimeTypes, QAbstractItemModel::supportedDropActions
-	 * \li submodel layout changes: QAbstractItemModel::layoutAboutToBeChanged, QAbstractItemModel::layoutChanged
-	 * \li submodel resetting: QAbstractItemModel::modelAboutToBeReset, QAbstractItemModel::modelReset
+	 *
+	 * In flat mode (see setFlat()), the submodels are not listed on the root level. Instead, the rows of all submodels are concatenated on the root level, as if they were the rows of one big list or table model (which is suitable for QListView or QTableView). The row numbers are translated with a prefix sum over the row counts of the submodels, so finding the submodel for a row takes O(log n) for n submodels, and row insertions and removals in the submodels are forwarded in O(log n) as well.
+	 *
+	 * In flat mode, sort() interleaves the rows of all submodels in one sorted order (by the sortRole() of the given column), without changing the submodels: The rows of each submodel are sorted once, and then merged. Afterwards, a row that is inserted, removed or changed in a submodel is moved to its place with a binary search, so that the submodels do not have to be sorted again. (The bookkeeping for a change still needs O(N) integer operations for N rows in total, but no comparisons of data.) Rows that are inserted, removed or changed at once are forwarded as few contiguous ranges; if they are scattered over too many places, they are forwarded as one insertion or removal at the end of the model and a layout change instead, which only costs one linear merge. In tree mode, sort() is forwarded to the submodels.
+	 *
+	 * Structural changes in the submodels (rows or columns being inserted, removed or moved) are forwarded immediately. (In sorted flat mode, root-level rows that move within a submodel are forwarded as a layout change, and rows that move between the root level and other parents as a reset; in flat mode, column moves are forwarded as a reset, like all column changes.) A layout change of a submodel is forwarded as a layout change, which updates only the persistent indexes of this submodel (or all root-level persistent indexes in sorted flat mode, where the rows of the submodels are interleaved). A reset of a submodel is forwarded as a removal of all its rows, followed by an insertion of the new rows, so that the persistent indexes of the other submodels stay valid (except in sorted flat mode, where the whole model is reset). The dataChanged() signals of the submodels are collected instead, and emitted once per event loop iteration (overlapping or adjacent ranges of a submodel are merged into one range, while a range elsewhere in the same submodel flushes the pending one first), or before the next structural change in the same submodel.
+	 *
+	 * For submodels which compute their data slowly, the results of data() can be kept in a cache (see setDataCacheSize()), which holds the given number of values and discards the least recently used ones. The cached values of a submodel are discarded when the submodel announces changes of these values, or structural changes that move them.
+	 *
+	 * The root-level rows of the submodels can be searched for a text with findRows(). For this purpose, the values of a chosen role (see setSearchRole()) in the first column are indexed by their trigrams (i.e., substrings of three characters). The index is built in a background thread, and it is updated when the submodels announce changes. A search therefore only needs to check the rows which contain the least common trigram of the text. Note that only the indexing runs in the background: The texts themselves have to be read in the GUI thread (because models are not thread-safe), which takes one data() call per row of a submodel when the search role is set, when the submodel is added, and after a layout change, reset or column change of the submodel. (The "search" benchmark in benchmark/ measures this.)
 	 */
 	class ModelListModel : public QAbstractItemModel
 	{
@@ -47,16 +64,28 @@ namespace Utils
 			ModelListModel(QObject* parent = 0);
 			virtual ~ModelListModel();
 
-			void addSubModel(QStandardItem* metaItem, QAbstractListModel* subModel); //DOCNOTE: takes ownership
-			void addSubModel(QStandardItem* metaItem, QAbstractTableModel* subModel); //DOCNOTE: overload
-			void addSubModel(const QString& caption, QAbstractListModel* subModel); //DOCNOTE: overload
-			void addSubModel(const QString& caption, QAbstractTableModel* subModel); //DOCNOTE: overload
+			void addSubModel(QStandardItem* metaItem, QAbstractItemModel* subModel); //DOCNOTE: takes ownership
+			void addSubModel(const QString& caption, QAbstractItemModel* subModel); //DOCNOTE: overload
 			void removeSubModel(QAbstractItemModel* subModel); //DOCNOTE: releases ownership
 			void setHeaderDataSubModel(QAbstractItemModel* subModel);
+			bool isFlat() const;
+			void setFlat(bool flat); //DOCNOTE: resets the model
+			int dataCacheSize() const;
+			void setDataCacheSize(int size); //DOCNOTE: 0 (the default) disables the cache
+			quint64 dataCacheHits() const;
+			quint64 dataCacheMisses() const;
+			int sortRole() const;
+			void setSortRole(int role); //DOCNOTE: Qt::DisplayRole by default
+			int searchRole() const;
+			void setSearchRole(int role); //DOCNOTE: -1 (the default) disables the search index
+			QList<int> findRows(QAbstractItemModel* subModel, const QString& text) const; //DOCNOTE: case-insensitive substring match on the root level of the submodel, returns sorted rows
+			QHash<QAbstractItemModel*, QList<int> > findRows(const QString& text) const; //DOCNOTE: overload, only submodels with matching rows are included
 
 			//QAbstractItemModel reimplementation
+			virtual bool canFetchMore(const QModelIndex& parent) const;
 			virtual int columnCount(const QModelIndex& parent = QModelIndex()) const;
 			virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+			virtual void fetchMore(const QModelIndex& parent);
 			virtual Qt::ItemFlags flags(const QModelIndex& index) const;
 			virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
 			virtual QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const;
@@ -70,32 +99,249 @@ namespace Utils
 			virtual bool setData(const QModelIndex& index, const QVariant& value, int role = Qt::EditRole);
 			virtual bool setHeaderData(int section, Qt::Orientation orientation, const QVariant& value, int role = Qt::EditRole);
 			virtual bool setItemData(const QModelIndex& index, const QMap<int, QVariant>& roles);
+			virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder); //DOCNOTE: column -1 restores the original order in flat mode
 		public Q_SLOTS:
 			virtual void revert();
 			virtual bool submit();
 		private Q_SLOTS: //slots for signal forwarding from submodels
 			void handleColumnsAboutToBeInserted(const QModelIndex& parent, int start, int end);
+			void handleColumnsAboutToBeMoved(const QModelIndex& sourceParent, int sourceStart, int sourceEnd, const QModelIndex& destinationParent, int destinationColumn);
 			void handleColumnsAboutToBeRemoved(const QModelIndex& parent, int start, int end);
-			void handleColumnsInserted();
-			void handleColumnsRemoved();
+			void handleColumnsInserted(const QModelIndex& parent, int start, int end);
+			void handleColumnsMoved(const QModelIndex& sourceParent, int sourceStart, int sourceEnd, const QModelIndex& destinationParent, int destinationColumn);
+			void handleColumnsRemoved(const QModelIndex& parent, int start, int end);
 			void handleDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
 			void handleHeaderDataChanged(Qt::Orientation orientation, int first, int last);
+			void handleLayoutAboutToBeChanged();
+			void handleLayoutChanged();
+			void handleModelAboutToBeReset();
+			void handleModelReset();
 			void handleRowsAboutToBeInserted(const QModelIndex& parent, int start, int end);
+			void handleRowsAboutToBeMoved(const QModelIndex& sourceParent, int sourceStart, int sourceEnd, const QModelIndex& destinationParent, int destinationRow);
 			void handleRowsAboutToBeRemoved(const QModelIndex& parent, int start, int end);
-			void handleRowsInserted();
-			void handleRowsRemoved();
+			void handleRowsInserted(const QModelIndex& parent, int start, int end);
+			void handleRowsMoved(const QModelIndex& sourceParent, int sourceStart, int sourceEnd, const QModelIndex& destinationParent, int destinationRow);
+			void handleRowsRemoved(const QModelIndex& parent, int start, int end);
 			void handleSubModelDeleted(QObject* model);
+			void flushPendingDataChanges();
+			void handleSearchIndexBuilt();
 		private:
 			typedef QPair<QAbstractItemModel*, QModelIndex> SubModelIndex;
 
+			//An entry in the node table: the internal ID of an index is the number of the node that describes its parent.
+			struct Node
+			{
+				QAbstractItemModel* model; //0 for unused nodes
+				QPersistentModelIndex sourceParent; //invalid for the root node of a submodel
+				QModelIndex key; //the value of sourceParent when the node was last inserted into m_nodeIds
+				bool isRoot;
+				QVector<int> children; //the nodes of the children of sourceParent (the nodes form one tree per submodel, so structural changes only visit the nodes below the changed parent)
+
+				Node() : model(0), isRoot(false) {}
+			};
+			enum { MetaNode = 0 }; //parent of the items of the metamodel
+			enum MoveForwarding { ForwardMove, ForwardLayoutChange, ForwardReset }; //how a move of rows or columns in a submodel is forwarded
+
+			struct DataCacheKey
+			{
+				int node, row, column, role; //row and column in the submodel
+				inline bool operator==(const DataCacheKey& other) const
+				{
+					return node == other.node && row == other.row && column == other.column && role == other.role;
+				}
+				friend inline uint qHash(const DataCacheKey& key)
+				{
+					return uint(key.node) ^ (uint(key.row) << 8) ^ (uint(key.column) << 24) ^ (uint(key.role) << 16);
+				}
+			};
+			typedef QMultiMap<int, DataCacheKey> DataCacheRows; //the cached keys of one node by row, so that invalidation only visits the affected rows
+			//A cached value, which removes its key from the side index when QCache deletes it (on eviction as well as on removal).
+			struct DataCacheEntry
+			{
+				QVariant value;
+				DataCacheKey key;
+				QHash<int, DataCacheRows>* keysByNode;
+
+				DataCacheEntry(const QVariant& value, const DataCacheKey& key, QHash<int, DataCacheRows>* keysByNode)
+					: value(value), key(key), keysByNode(keysByNode) {}
+				~DataCacheEntry();
+			};
+
+			//A Fenwick tree over the row counts of the submodels, which yields the row offset of each submodel in flat mode.
+			class RowOffsets
+			{
+				public:
+					RowOffsets();
+					void append(int count);
+					void removeAt(int index);
+					void add(int index, int delta);
+					int count(int index) const;
+					int offset(int index) const; //sum of the counts before this index
+					int total() const;
+					int indexOf(int row) const; //the index whose rows contain the given row, or -1
+				private:
+					void rebuild();
+
+					QVector<int> m_counts;
+					QVector<int> m_tree; //1-based: m_tree[i] is the sum of the counts in (i - lowbit(i), i]
+					int m_total;
+			};
+
+			//The trigram index of the search texts (in case-folded form) of the root-level rows of one submodel. The texts are stored per item, which is a row number that does not change when other rows are inserted or removed. The lists of items per trigram are not updated when texts are removed or changed (because that would need a search in each of these lists), so they contain outdated items which are filtered out during the search, until the next rebuild.
+			class SearchIndex
+			{
+				public:
+					typedef QHash<quint64, QVector<int> > Postings;
+
+					SearchIndex();
+					void setTexts(const QVector<QString>& texts);
+					void insertRows(int start, const QVector<QString>& texts);
+					void removeRows(int start, int end);
+					void setText(int row, const QString& text);
+					QList<int> match(const QString& text) const;
+
+					//a build takes a snapshot of the texts, which is indexed in a background thread by buildPostings(); until endBuild() swaps in the new postings, queries are answered from the old ones, which receive the changes during the build as well
+					QVector<QString> beginBuild();
+					void endBuild(const Postings& postings);
+					static Postings buildPostings(const QVector<QString>& texts);
+					bool needsRebuild() const;
+				private:
+					static QVector<quint64> trigrams(const QString& text);
+					int allocateItem(const QString& text);
+					void releaseItem(int item);
+					void indexItem(int item);
+					void addPostings(int item);
+					void renumberRows(int firstRow);
+
+					QVector<QString> m_texts; //per item
+					QVector<int> m_rowItems;
+					QVector<int> m_itemRows; //-1 for unused items
+					QVector<int> m_freeItems;
+					Postings m_postings;
+					QVector<int> m_unindexedItems; //changed while a build is running (or before the first build)
+					bool m_indexed; //whether m_postings is available, i.e. the first build has finished
+					bool m_building;
+					int m_staleItems; //number of removed or changed items which may still be listed in m_postings
+			};
+
+			//The order of the root-level rows of all submodels in sorted flat mode. The rows are ordered by their sort key, then by submodel, then by source row, so the order is strict (and rows with equal keys keep their relative order). Submodels are referred to by their index in m_subModels.
+			class MergedOrder
+			{
+				public:
+					MergedOrder();
+					void clear();
+					void build(const QVector<QVector<QVariant> >& keys, Qt::SortOrder order); //keys per submodel and source row
+					int count() const;
+					int subModelAt(int row) const;
+					int sourceRowAt(int row) const;
+					const QVariant& key(int subModel, int sourceRow) const;
+					int rowOf(int subModel, int sourceRow) const; //-1 if this row is not contained
+					int insertionRow(int subModel, int sourceRow, const QVariant& key) const; //where a row with this key belongs
+					void remove(int row, int count);
+					void move(int row, int destination, const QVariant& key); //destination as in QAbstractItemModel::beginMoveRows
+					void setKey(int subModel, int sourceRow, const QVariant& key);
+					void updateKeys(int subModel, int start, const QVector<QVariant>& keys); //sorts the changed rows again, and merges them with the others
+					void replaceSubModel(int subModel, const QVector<QVariant>& keys); //sorts the rows of this submodel again, and merges them with the others
+					void insertSourceRows(int subModel, int start, const QVector<QVariant>& keys); //the new rows are not contained until they are insert()ed or appendToTail()ed
+					void removeSourceRows(int subModel, int start, int count); //the removed rows must have been remove()d or removeTail()ed before
+					//New rows of one submodel are inserted in runs of rows which end up next to each other. If there are more than MaxRuns runs, the changes are instead forwarded as one insertion or removal at the end, and a layout change: the rows are then kept in the tail, an unsorted range at the end which contains the given source rows in their order.
+					enum { MaxRuns = 8 };
+					struct Run
+					{
+						int row, first, count; //the run is inserted at row, and contains sortedSourceRows[first..first+count-1]
+					};
+					QVector<Run> insertionRuns(int subModel, int start, int count, QVector<int>& sortedSourceRows) const; //in the order in which the runs have to be inserted
+					void insert(const Run& run, int subModel, const QVector<int>& sortedSourceRows);
+					void appendToTail(int subModel, int start, int count);
+					void moveToTail(int subModel, int start, int count);
+					void mergeTail();
+					void removeTail();
+					static bool lessThan(const QVariant& left, const QVariant& right);
+				private:
+					struct Entry
+					{
+						int subModel, sourceRow;
+					};
+					struct EntryLessThan
+					{
+						const MergedOrder* order;
+						bool inverted; //for the heap in build()
+						bool operator()(const Entry& left, const Entry& right) const;
+					};
+					bool entryLessThan(const Entry& left, const QVariant& leftKey, const Entry& right, const QVariant& rightKey) const;
+
+					int sortedCount() const; //without the tail
+					void resort(int subModel, int start, int count);
+
+					QVector<Entry> m_entries;
+					QVector<QVector<QVariant> > m_keys;
+					Qt::SortOrder m_order;
+					int m_tailSubModel, m_tailSourceRow, m_tailCount;
+			};
+
 			void addSubModelInternal(QStandardItem* metaItem, QAbstractItemModel* model);
 			SubModelIndex mapToSource(const QModelIndex& index) const;
 			QModelIndex mapFromSource(const SubModelIndex& index) const;
 			QAbstractItemModel* safeModelCast(void* model) const;
+			int rowOffset(QAbstractItemModel* subModel) const;
+			int sourceRow(const QModelIndex& index, const Node& node) const;
+			int flatRow(QAbstractItemModel* subModel, int sourceRow) const;
+			bool isMerged() const;
+			int subModelColumnCount() const;
+			void updateFlatColumnCount();
+			MoveForwarding moveForwarding(const QModelIndex& sourceParent, const QModelIndex& destinationParent, Qt::Orientation orientation) const;
+			void invalidateMovedData(QAbstractItemModel* subModel, const QModelIndex& sourceParent, int sourceStart, const QModelIndex& destinationParent, int destination, Qt::Orientation orientation) const;
+			void rekeyMovedNodes(QAbstractItemModel* subModel, const QModelIndex& sourceParent, int sourceStart, const QModelIndex& destinationParent, int destination, Qt::Orientation orientation);
+			QVariant sortKey(QAbstractItemModel* subModel, int sourceRow) const;
+			void rebuildMergedOrder();
+			void beginLayoutChange(QAbstractItemModel* subModel);
+			void endLayoutChange();
+			const Node* nodeAt(qint64 id) const;
+			int nodeFor(QAbstractItemModel* subModel, const QModelIndex& sourceParent) const;
+			int allocateNode(QAbstractItemModel* subModel, const QModelIndex& sourceParent, bool isRoot) const;
+			void freeNode(int id) const;
+			void freeNodeTree(int id) const;
+			void collectNodes(int id, QVector<int>& ids) const;
+			void rekeyNodes(QAbstractItemModel* subModel);
+			void rekeyNodes(QAbstractItemModel* subModel, const QModelIndex& sourceParent, int start, Qt::Orientation orientation);
+			int existingNodeFor(QAbstractItemModel* subModel, const QModelIndex& sourceParent) const;
+			void invalidateDataCache(int node, int firstRow, int lastRow, int firstColumn, int lastColumn) const;
+			void invalidateDataCache(QAbstractItemModel* subModel) const;
+			QVector<QString> searchTexts(QAbstractItemModel* subModel, int first, int last) const;
+			void buildSearchIndex(QAbstractItemModel* subModel, bool readTexts);
+			void updateSearchIndex(QAbstractItemModel* subModel);
+			void flushDataChanges(QAbstractItemModel* subModel);
 
 			QStandardItemModel* m_metaModel;
 			QList<QAbstractItemModel*> m_subModels;
+			QHash<QAbstractItemModel*, int> m_subModelRows; //reverse index of m_subModels (safeModelCast and mapFromSource are called for nearly every index, so they need to be fast)
 			QAbstractItemModel* m_headerDataSubModel;
+			QHash<QAbstractItemModel*, QRect> m_pendingDataChanges; //changed range of each submodel since the last flush (x = columns, y = rows), see handleDataChanged
+			bool m_flushScheduled;
+			bool m_flat;
+			int m_flatColumnCount; //the column count of the root level in flat mode (see updateFlatColumnCount)
+			RowOffsets m_rowOffsets; //maintained in both modes
+			int m_sortColumn; //-1 if not sorted
+			Qt::SortOrder m_sortOrder;
+			int m_sortRole;
+			MergedOrder m_mergedOrder; //only maintained in sorted flat mode
+			//state of layout changes and resets of submodels
+			QModelIndexList m_layoutProxyIndexes; //the persistent indexes of the submodel whose layout changes
+			QList<QPersistentModelIndex> m_layoutSourceIndexes; //their source indexes
+			QModelIndexList m_layoutMergedIndexes; //in sorted flat mode, the root-level persistent indexes of the other submodels, which only move in the merged order
+			QVector<QPair<int, int> > m_layoutMergedRows; //their submodel and source row (which do not change, so they need no persistent index in the submodel)
+			QSet<QAbstractItemModel*> m_resettingSubModels; //between modelAboutToBeReset and modelReset
+			//the node table (which grows when indexes are created, hence mutable)
+			mutable QVector<Node> m_nodes;
+			mutable QVector<int> m_freeNodes;
+			mutable QHash<QModelIndex, int> m_nodeIds; //maps source parents to their nodes
+			QHash<QAbstractItemModel*, int> m_rootNodes; //the root of the node tree of each submodel
+			mutable QHash<int, DataCacheRows> m_dataCacheKeys; //side index of m_dataCache by node (declared first, so that it outlives the cache entries)
+			mutable QCache<DataCacheKey, DataCacheEntry> m_dataCache;
+			mutable quint64 m_dataCacheHits, m_dataCacheMisses;
+			int m_searchRole;
+			QHash<QAbstractItemModel*, SearchIndex*> m_searchIndexes;
+			QHash<QAbstractItemModel*, QObject*> m_searchBuilds; //the QFutureWatcher of the running build of each submodel
 	};
 }
 
@@ -6,7 +6,15 @@ TEMPLATE = app
 TARGET = modellistmodeltest
 DEPENDPATH += .
 INCLUDEPATH += .
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets testlib concurrent
 
 # Input
 HEADERS += modellistmodel.h testing.h
 SOURCES += modellistmodel.cpp testing.cpp
+
+# Qt 4 has no QAbstractItemModelTester; copy modeltest.{h,cpp} from Qt 4's tests/auto/modeltest here to use its ModelTest instead
+lessThan(QT_MAJOR_VERSION, 5):exists(modeltest.cpp) {
+	DEFINES += HAVE_MODELTEST
+	HEADERS += modeltest.h
+	SOURCES += modeltest.cpp
+}
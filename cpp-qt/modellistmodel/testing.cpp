@@ -23,6 +23,13 @@
 #include "modellistmodel.h"
 #include "testing.h"
 
+//check every signal of the main model for consistency (this catches e.g. missing or misplaced column and row signals)
+#if QT_VERSION >= 0x050B00
+#include <QAbstractItemModelTester>
+#elif defined(HAVE_MODELTEST)
+#include "modeltest.h" //from Qt 4's tests/auto/modeltest, see modellistmodel.pro
+#endif
+
 #if 0
 MySubModel::MySubModel(const QString& name)
 {
@@ -87,6 +94,11 @@ int main(int argc, char** argv)
 	subLayout->addWidget(v3);
 
 	Utils::ModelListModel* mainModel = new Utils::ModelListModel;
+#if QT_VERSION >= 0x050B00
+	new QAbstractItemModelTester(mainModel, QAbstractItemModelTester::FailureReportingMode::Fatal, mainModel);
+#elif defined(HAVE_MODELTEST)
+	new ModelTest(mainModel, mainModel);
+#endif
 	mainModel->addSubModel("Foo model", v1->model());
 	mainModel->addSubModel("Bar model", v2->model());
 	mainModel->addSubModel("Baz model", v3->model());
@@ -0,0 +1,138 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+#ifndef UTILS_STATICSOA_H
+#define UTILS_STATICSOA_H
+
+#include "staticvector.h"
+
+#include <tuple>
+
+namespace Utils
+{
+	/**
+	 * \class StaticSoA
+	 *
+	 * This class stores records in the "structure of arrays" layout: Instead of one StaticVector<Record>, it holds one StaticVector per field of the record (called "columns" here), which all have the same size. Loops that only touch some fields then only load the memory of these fields.
+\code
+//instead of: struct Particle { QVector3D position; QVector3D velocity; float mass; };
+enum { Position, Velocity, Mass };
+Utils::StaticSoA<QVector3D, QVector3D, float> particles;
+particles.resize(particleCount);
+float* masses = particles.data<Mass>(); //can be passed to ODE, OpenGL etc.
+\endcode
+	 * All columns follow the rules of StaticVector: Their memory never moves until the next resize(), a copy of a StaticSoA is a read-only copy of all columns, and only the instance that called resize() may write the data.
+	 *
+	 * \note This class needs a compiler with support for variadic templates (C++11).
+	 */
+	template<typename... Columns> class StaticSoA
+	{
+		public:
+			///The type of the column with index \a I.
+			template<int I> struct Column
+			{
+				typedef typename std::tuple_element<I, std::tuple<Columns...> >::type Type;
+			};
+
+			///Resizes all columns (see StaticVector::resize()).
+			///\warning This discards all values saved in the columns.
+			inline void resize(int size);
+			///Resizes all columns, and aligns the first element of every column to \a alignment (see StaticVector::resize()).
+			///\warning This discards all values saved in the columns.
+			inline void resize(int size, int alignment);
+
+			///Returns the number of records.
+			inline int size() const;
+			///Same as size().
+			inline int count() const;
+			///Returns whether this instance may write the data.
+			inline bool isWritable() const;
+
+			///Returns the column with index \a I. The column is const because it may only be resized together with all other columns (through resize()); use element() or data() to write values.
+			template<int I> inline const Utils::StaticVector<typename Column<I>::Type>& column() const;
+			///Returns the value of the column with index \a I in the record at \a index (see StaticVector::at()).
+			template<int I> inline const typename Column<I>::Type& at(int index) const;
+			///Returns a writable reference to the value of the column with index \a I in the record at \a index (see StaticVector::operator[]).
+			template<int I> inline typename Column<I>::Type& element(int index);
+			///Returns a pointer to the data of the column with index \a I (see StaticVector::data()).
+			template<int I> inline typename Column<I>::Type* data() const;
+		private:
+			template<int I> inline typename std::enable_if<(I < sizeof...(Columns))>::type resizeColumns(int size, int alignment);
+			template<int I> inline typename std::enable_if<(I == sizeof...(Columns))>::type resizeColumns(int, int) {}
+
+			std::tuple<Utils::StaticVector<Columns>...> m_columns;
+	};
+}
+
+template<typename... Columns> void Utils::StaticSoA<Columns...>::resize(int size)
+{
+	resizeColumns<0>(size, 0);
+}
+
+template<typename... Columns> void Utils::StaticSoA<Columns...>::resize(int size, int alignment)
+{
+	resizeColumns<0>(size, alignment);
+}
+
+template<typename... Columns> template<int I> typename std::enable_if<(I < sizeof...(Columns))>::type Utils::StaticSoA<Columns...>::resizeColumns(int size, int alignment)
+{
+	std::get<I>(m_columns).resize(size, alignment);
+	resizeColumns<I + 1>(size, alignment);
+}
+
+template<typename... Columns> int Utils::StaticSoA<Columns...>::size() const
+{
+	return std::get<0>(m_columns).size();
+}
+
+template<typename... Columns> int Utils::StaticSoA<Columns...>::count() const
+{
+	return size();
+}
+
+template<typename... Columns> bool Utils::StaticSoA<Columns...>::isWritable() const
+{
+	//all columns are resized and copied together, so they always agree on this
+	return std::get<0>(m_columns).isWritable();
+}
+
+template<typename... Columns> template<int I> const Utils::StaticVector<typename Utils::StaticSoA<Columns...>::template Column<I>::Type>& Utils::StaticSoA<Columns...>::column() const
+{
+	return std::get<I>(m_columns);
+}
+
+template<typename... Columns> template<int I> const typename Utils::StaticSoA<Columns...>::template Column<I>::Type& Utils::StaticSoA<Columns...>::at(int index) const
+{
+	return std::get<I>(m_columns).at(index);
+}
+
+template<typename... Columns> template<int I> typename Utils::StaticSoA<Columns...>::template Column<I>::Type& Utils::StaticSoA<Columns...>::element(int index)
+{
+	return std::get<I>(m_columns)[index];
+}
+
+template<typename... Columns> template<int I> typename Utils::StaticSoA<Columns...>::template Column<I>::Type* Utils::StaticSoA<Columns...>::data() const
+{
+	return std::get<I>(m_columns).data();
+}
+
+#endif //UTILS_STATICSOA_H
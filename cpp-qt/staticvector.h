@@ -23,11 +23,45 @@
 #ifndef UTILS_STATICVECTOR_H
 #define UTILS_STATICVECTOR_H
 
+#include <climits>
 #include <cstdlib>
+#include <new>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
 #include <QtCore/QtGlobal>
+#ifdef Q_OS_UNIX
+#	include <cstdio>
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+#ifdef Q_OS_WIN
+#	include <malloc.h>
+#endif
+
+#ifdef UTILS_STATICVECTOR_STATISTICS
+#	include <typeinfo>
+#	include "staticvectorstatistics.h"
+#endif
+
+//the std::is_trivially_* traits are only complete in the standard libraries of GCC 5 and MSVC 2015 (and later)
+#if (__cplusplus >= 201103L && (!defined(__GLIBCXX__) || __GNUC__ >= 5)) || (defined(_MSC_VER) && _MSC_VER >= 1900)
+#	define UTILS_STATICVECTOR_TYPE_TRAITS
+#	include <type_traits>
+#endif
+
+#ifdef Q_DECL_NOEXCEPT
+#	define UTILS_STATICVECTOR_NOEXCEPT Q_DECL_NOEXCEPT
+#else //Qt 4
+#	define UTILS_STATICVECTOR_NOEXCEPT throw()
+#endif
 
 namespace Utils
 {
+	template<typename T> class StaticVectorSlice;
+
 	/**
 	 * \class StaticVector
 	 *
@@ -55,19 +89,129 @@ passMyDataToSomeOtherSubsystem(container.payload().data(), container.payload().s
 	 *
 	 * StaticVectors are implicitly shared for performance reasons, but do not detach from the shared data on changes (for the reason described above). To keep copied instances from modifying the original data, only the one instance that allocated the data object is allowed to change the data (any write attempt by other instances will trigger an assertion and crash the program, at least to the extent possible in C++).
 	 *
-	 * \warning Unlike QVector, StaticVector does not resize automatically.
+	 * The write access moves along with the data if a vector is moved (with C++11 move semantics). It can also be handed over explicitly: When the writing instance calls releaseWriteAccess() (or drops the data), any other instance sharing the data may claim it with takeWriteAccess(). This allows a producer to pass a finished buffer to a consumer without copying it:
+\code
+Utils::StaticVector<float> buffer; //member of the consumer
+...
+buffer = producer->finishedBuffer(); //read-only copy
+producer->discardFinishedBuffer(); //calls releaseWriteAccess() or drops the data
+buffer.takeWriteAccess();
+\endcode
+	 *
+	 * The reference counter is atomic, so read-only copies may be created, passed to and destroyed in other threads without further locking. The data is freed exactly once, by whichever thread drops the last reference. (The data itself is not protected, of course: If the writing instance changes the data while other threads read it, you have to synchronize this yourself.)
+	 *
+	 * If the data is handed to vectorized code, resize() can be told to align the elements to a cache line or SIMD register width:
+\code
+Utils::StaticVector<float> samples;
+samples.resize(1 << 20, Utils::StaticVector<float>::Avx512Alignment);
+\endcode
+	 * Big buffers can additionally be backed by transparent huge pages (on Linux) with the HugePageHint.
+	 *
+	 * Binary files containing arrays of T can be used as data without reading them into memory (see mapFile()). Their pages are loaded on first access, and are shared with all other processes that map the same file.
+	 *
+	 * The data can also be shared with other processes on the same host through POSIX shared memory: One process creates the data with createShared() and is the only writer, and every other process gets a read-only copy with attachShared().
+	 *
+	 * Like QVector, StaticVector uses QTypeInfo to find out whether T needs to be constructed and destructed. Elements of primitive types (e.g. int, float or pointers, and everything declared with Q_DECLARE_TYPEINFO as Q_PRIMITIVE_TYPE) are not initialized for performance reasons. Complex types (e.g. QString or QVariant) are default-constructed when they enter the vector, and destructed when the last copy of the vector drops the data. With a C++11 standard library, the standard type traits are consulted as well, so that plain structs count as primitive even without Q_DECLARE_TYPEINFO (if they are trivially default-constructible, trivially destructible or trivially copyable, respectively).
+	 *
+	 * If UTILS_STATICVECTOR_STATISTICS is defined, all data blocks are tracked by StaticVectorStatistics.
+	 *
+	 * Write protection can be left to the hardware: resizeProtected() creates a read-only mapping of the data in addition to the writable one. If UTILS_STATICVECTOR_PAGE_PROTECTION is defined, operator[] of read-only copies uses this mapping, so they can use operator[] for reading, but any write through them crashes the program with a segmentation fault. (Read-only copies of other data still fail in operator[] as usual.) The macro does not change the layout of StaticVector, but like all configuration macros of this class, it should be defined in all translation units or in none of them (preferably through the build system).
+	 *
+	 * \warning Unlike QVector, StaticVector does not resize automatically. If the final size is not known in advance, reserve() an upper bound for the capacity: This only reserves address space, and grow() and append() then commit memory as needed, without ever moving existing elements.
 	 */
 	template<typename T> class StaticVector
 	{
+		public:
+			///Common values for the alignment argument of resize().
+			enum Alignment
+			{
+				DefaultAlignment = 0, //the natural alignment of T
+				AvxAlignment = 32,
+				CacheLineAlignment = 64,
+				Avx512Alignment = 64
+			};
+			enum AllocationHint
+			{
+				NoAllocationHint = 0,
+				HugePageHint = 1 //ask the kernel to back the data by transparent huge pages (only on Linux; ignored elsewhere)
+			};
+			enum MapMode
+			{
+				ReadOnlyMapping, //no instance may write the data
+				PrivateMapping //the mapping instance may write the data, but changes are not written back to the file (copy-on-write)
+			};
 		private:
-			struct Data //the internal data class for implicit sharing
+			enum Storage
+			{
+				HeapStorage, //allocated with malloc()
+				AlignedHeapStorage, //allocated with posix_memalign() or _aligned_malloc()
+				MappedStorage, //header allocated with malloc(), elements in a file mapping
+				SharedMemoryStorage, //header allocated with malloc(), elements in a mapping of a POSIX shared memory object
+				ReservedStorage, //header allocated with malloc(), elements in a reserved address range which is committed on demand
+				ProtectedStorage //header allocated with malloc(), elements in an anonymous shared memory object which is mapped twice (writable and read-only)
+			};
+			enum { HugePageSize = 2 * 1024 * 1024 };
+			//how the elements are treated (see class documentation): with the standard type traits, trivial types need neither QTypeInfo nor Q_DECLARE_TYPEINFO
+#ifdef UTILS_STATICVECTOR_TYPE_TRAITS
+			enum
+			{
+				NeedsConstruction = QTypeInfo<T>::isComplex && !std::is_trivially_default_constructible<T>::value,
+				NeedsDestruction = QTypeInfo<T>::isComplex && !std::is_trivially_destructible<T>::value,
+				IsPlainData = !QTypeInfo<T>::isComplex || std::is_trivially_copyable<T>::value //may be read from files and shared memory
+			};
+#else
+			enum
+			{
+				NeedsConstruction = QTypeInfo<T>::isComplex,
+				NeedsDestruction = QTypeInfo<T>::isComplex,
+				IsPlainData = !QTypeInfo<T>::isComplex
+			};
+#endif
+			struct Extension //the part of the data which only non-heap storage needs; kept out of Data, so that heap data stays small and does not touch QByteArray
+			{
+				void* m_mapping; //for MappedStorage, SharedMemoryStorage, ReservedStorage and ProtectedStorage
+				size_t m_mappingLength;
+				size_t m_committedLength; //for ReservedStorage
+				QByteArray m_sharedMemoryName; //for SharedMemoryStorage, if this process has created the shared memory object
+				T* m_readOnlyBase; //for ProtectedStorage and read-only mappings: the elements, mapped read-only
+
+				inline Extension(void* mapping, size_t mappingLength)
+					: m_mapping(mapping), m_mappingLength(mappingLength), m_committedLength(0), m_readOnlyBase(0) {}
+			};
+			struct Data //the internal data class for implicit sharing; for heap storage, the elements are stored directly behind this header (in the same allocation)
 			{
 				T* m_base;
+				Storage m_storage;
 				int m_size;
-				StaticVector* m_writeAccessVector; //a pointer to the only vector that is allowed to write on this data
-				int m_refCounter; //to determine when to delete this object
+				QAtomicInt m_writeAccessClaimed; //1 while some instance holds the write access (the instance itself knows this from its m_writable)
+				QAtomicInt m_refCounter; //to determine when to delete this object
+				Extension* m_extension; //allocated by setMappedData() for non-heap storage, 0 for heap storage
+
+				inline Data(T* base, Storage storage, int size, bool writable)
+					: m_base(base), m_storage(storage), m_size(size)
+					, m_writeAccessClaimed(writable ? 1 : 0)
+					, m_refCounter(1) //the creating instance holds the only reference currently
+					, m_extension(0) {}
 			};
 			Data* m_data;
+			bool m_writable; //whether this instance holds the write access to m_data (never read by other instances, so it needs no synchronization)
+			T* m_access; //the elements as seen by operator[], or null if operator[] is not allowed (not dependent on UTILS_STATICVECTOR_PAGE_PROTECTION, so that the class layout is the same in all translation units)
+
+			inline void release();
+			inline void updateAccess();
+			static inline void deref(Data* data);
+#ifdef UTILS_STATICVECTOR_STATISTICS
+			static inline void registerData(Data* data);
+			static inline void inspectData(const void* data, int* refCount, bool* orphaned);
+#endif
+			static inline size_t payloadOffset(size_t alignment);
+			static inline void constructElements(T* begin, T* end);
+			static inline void destructElements(T* begin, T* end);
+			inline void setMappedData(void* mapping, size_t mappingLength, T* base, Storage storage, int size, bool writable);
+#ifdef Q_OS_UNIX
+			inline bool mapDescriptor(int fd, qint64 offset, qint64 size, int protection, int flags, Storage storage, bool writable);
+			static inline QByteArray sharedMemoryObjectName(const QString& name);
+#endif
 		public:
 			///Initializes a new shared vector that initially is not able to hold any data. (You have to call resize() first.)
 			inline StaticVector();
@@ -75,9 +219,62 @@ passMyDataToSomeOtherSubsystem(container.payload().data(), container.payload().s
 			inline StaticVector(const Utils::StaticVector<T>& other);
 			///Destroys the vector.
 			inline ~StaticVector();
+			///Makes this vector a read-only copy of \a other.
+			inline Utils::StaticVector<T>& operator=(const Utils::StaticVector<T>& other);
+#ifdef Q_COMPILER_RVALUE_REFS
+			///Moves the data of \a other into a new vector. If \a other had write access to the data, the new vector has it now. \a other is empty afterwards.
+			inline StaticVector(Utils::StaticVector<T>&& other) UTILS_STATICVECTOR_NOEXCEPT;
+			///Moves the data of \a other into this vector. If \a other had write access to the data, this vector has it now. \a other is empty afterwards.
+			inline Utils::StaticVector<T>& operator=(Utils::StaticVector<T>&& other) UTILS_STATICVECTOR_NOEXCEPT;
+#endif
 			///Resizes the vector.
-			///\warning This discards all values saved in the vector. The elements are not initialized for performance reasons.
+			///\warning This discards all values saved in the vector. Elements of primitive types are not initialized for performance reasons.
 			inline void resize(int size);
+			///Resizes the vector, and places the first element at an address that is a multiple of \a alignment (which has to be a power of two, see Alignment for common values). The \a hint may be used to select special memory for the data.
+			///\warning This discards all values saved in the vector. Elements of primitive types are not initialized for performance reasons.
+			inline void resize(int size, int alignment, AllocationHint hint = NoAllocationHint);
+			///Resizes the vector like resize(), but places the elements in memory that is mapped twice: Only this instance may write through the writable mapping, while all read-only copies access the elements through the read-only mapping (in operator[], if UTILS_STATICVECTOR_PAGE_PROTECTION is defined).
+			///\return whether the memory could be mapped (if not, the vector keeps its previous data)
+			///\note This is only implemented on Unix systems. On other systems, this method always fails.
+			///\warning This discards all values saved in the vector. Elements of primitive types are not initialized (the operating system initializes them to zero bytes, though).
+			inline bool resizeProtected(int size);
+			///Replaces the data of this vector by a memory mapping of the file \a fileName, starting at byte \a offset (which has to be a multiple of the alignment of T). The file is interpreted as an array of T; trailing bytes which do not form a complete element are ignored. The mapping is released when the last copy of this vector drops the data.
+			///With the PrivateMapping \a mode, this instance may change the data, but the changes are never written back to the file. With the ReadOnlyMapping \a mode, no instance may write the data (i.e., also not this instance).
+			///\return whether the file could be mapped (if not, the vector keeps its previous data)
+			///\note This is only implemented on Unix systems. On other systems, this method always fails. It also fails if T is a complex type that is not trivially copyable (see class documentation), because files cannot contain constructed objects.
+			inline bool mapFile(const QString& fileName, MapMode mode = ReadOnlyMapping, qint64 offset = 0);
+			///Replaces the data of this vector by \a size elements in a new POSIX shared memory object called \a name, which other processes can attach to with attachShared(). This instance has write access to the data. The shared memory object is removed when the last copy of this vector in this process drops the data (processes which are attached at this point keep their data, though).
+			///\return whether the shared memory object could be created (if not, e.g. because an object with this name exists already, the vector keeps its previous data)
+			///\note This is only implemented on Unix systems (on some of them, you need to link against librt). On other systems, this method always fails. It also fails if T is a complex type that is not trivially copyable (see class documentation).
+			///\warning The elements are not initialized (the operating system initializes them to zero bytes, though).
+			inline bool createShared(const QString& name, int size);
+			///Replaces the data of this vector by a read-only mapping of the POSIX shared memory object \a name, which has been created by createShared() in another process. No instance in this process may write the data.
+			///\return whether the shared memory object could be attached (if not, the vector keeps its previous data)
+			///\note The same restrictions as for createShared() apply.
+			inline bool attachShared(const QString& name);
+			///Drops the data of this vector (i.e., detaches from shared memory objects). This is the same as resize(0).
+			inline void clear();
+			///Replaces the data of this vector by an empty data block that can grow up to \a capacity elements without moving. Only address space is reserved at this point; memory is committed page by page in grow() and append().
+			///\return whether the address space could be reserved (if not, the vector keeps its previous data)
+			///\note This is only implemented on Unix systems. On other systems, this method always fails.
+			inline bool reserve(int capacity);
+			///Increases the size of the vector to \a size, keeping all elements at their current address. This operation is only allowed if the data in this vector is writable, and was created by reserve().
+			///\return whether the vector could be grown, i.e. \a size is between the current size and capacity() and the memory could be committed
+			///\warning New elements of primitive types are not initialized for performance reasons.
+			inline bool grow(int size);
+			///Adds \a value to the end of the vector, with the same restrictions as grow().
+			inline bool append(const T& value);
+			///Returns whether this instance may write the data.
+			inline bool isWritable() const;
+			///Returns whether other instances share the data of this vector.
+			inline bool isShared() const;
+			///Gives up the write access to the data of this vector, so that another instance sharing the data can claim it with takeWriteAccess().
+			inline void releaseWriteAccess();
+			///Claims the write access to the data of this vector. This only succeeds if no instance currently has write access (because the previous writer has called releaseWriteAccess() or dropped the data), and if the data is not a read-only file mapping.
+			///\return whether this instance has write access now
+			inline bool takeWriteAccess();
+			///Returns the maximum size that this vector can grow() to. For data not created by reserve(), this is the same as size().
+			inline int capacity() const;
 
 			///Returns the number of items in this vector.
 			inline int size() const;
@@ -90,8 +287,50 @@ passMyDataToSomeOtherSubsystem(container.payload().data(), container.payload().s
 			inline T value(int i, const T& defaultValue) const;
 			///Returns the item at index position \a i in the vector. \a i must be a valid index position in the vector (i.e., 0 <= \a i < size()).
 			inline const T& at(int i) const;
-			///Same as at(), but this operation is only allowed if the data in this vector is writable (i.e., the data was created by a resize() call in this very instance).
+			///Same as at(), but this operation is only allowed if the data in this vector is writable (i.e., the data was created by this very instance, and is not a read-only mapping).
 			inline T& operator[](int i);
+
+			///Returns a read-only view on \a length elements of this vector, starting at index position \a pos. If \a length is -1 (the default), all elements from \a pos to the end are included. The range is clamped to the valid index positions.
+			///The slice shares the data of this vector (which stays alive as long as the slice exists), so this operation does not allocate anything.
+			inline Utils::StaticVectorSlice<T> mid(int pos, int length = -1) const;
+
+			friend class Utils::StaticVectorSlice<T>;
+	};
+
+	/**
+	 * \class StaticVectorSlice
+	 *
+	 * A read-only view on a range of a StaticVector, as created by StaticVector::mid(). Like a read-only copy of the StaticVector, it holds a reference to the vector's data, so the data stays alive and at the same address as long as the slice exists.
+	 */
+	template<typename T> class StaticVectorSlice
+	{
+		public:
+			///Initializes an empty slice.
+			inline StaticVectorSlice();
+			inline StaticVectorSlice(const Utils::StaticVectorSlice<T>& other);
+			inline ~StaticVectorSlice();
+			inline Utils::StaticVectorSlice<T>& operator=(const Utils::StaticVectorSlice<T>& other);
+
+			///Returns the number of items in this slice.
+			inline int size() const;
+			///Same as size().
+			inline int count() const;
+			///Returns a pointer to the first item of this slice. The pointer is non-const for the same reasons as in StaticVector::data(), but the data must not be changed through it.
+			inline T* data() const;
+			///Returns the value at index position \a i in the slice (i.e., at index position offset() + \a i in the vector). If the index \a i is out of bounds, returns \a defaultValue instead.
+			inline T value(int i, const T& defaultValue) const;
+			///Returns the item at index position \a i in the slice. \a i must be a valid index position in the slice (i.e., 0 <= \a i < size()).
+			inline const T& at(int i) const;
+			///Returns the index position in the original vector at which this slice starts.
+			inline int offset() const;
+		private:
+			typedef typename Utils::StaticVector<T>::Data Data;
+			friend class Utils::StaticVector<T>;
+			inline StaticVectorSlice(Data* data, int offset, int size);
+
+			Data* m_data;
+			int m_offset;
+			int m_size;
 	};
 }
 
@@ -100,45 +339,481 @@ passMyDataToSomeOtherSubsystem(container.payload().data(), container.payload().s
 template<typename T> Utils::StaticVector<T>::StaticVector()
 {
 	m_data = 0;
+	m_writable = false;
+	updateAccess();
 }
 
 template<typename T> Utils::StaticVector<T>::StaticVector(const Utils::StaticVector<T>& other)
 {
 	m_data = other.m_data;
+	m_writable = false;
 	if (m_data)
-		++m_data->m_refCounter;
+		m_data->m_refCounter.ref();
+	updateAccess();
 }
 
 template<typename T> Utils::StaticVector<T>::~StaticVector()
 {
-	if (m_data && --m_data->m_refCounter == 0)
+	release();
+}
+
+template<typename T> Utils::StaticVector<T>& Utils::StaticVector<T>::operator=(const Utils::StaticVector<T>& other)
+{
+	if (m_data == other.m_data) //includes self-assignment; also keeps the write access
+		return *this;
+	Data* newData = other.m_data;
+	if (newData)
+		newData->m_refCounter.ref();
+	release();
+	m_data = newData;
+	updateAccess();
+	return *this;
+}
+
+#ifdef Q_COMPILER_RVALUE_REFS
+template<typename T> Utils::StaticVector<T>::StaticVector(Utils::StaticVector<T>&& other) UTILS_STATICVECTOR_NOEXCEPT
+{
+	m_data = other.m_data;
+	m_writable = other.m_writable;
+	other.m_data = 0;
+	other.m_writable = false;
+	updateAccess();
+	other.updateAccess();
+}
+
+template<typename T> Utils::StaticVector<T>& Utils::StaticVector<T>::operator=(Utils::StaticVector<T>&& other) UTILS_STATICVECTOR_NOEXCEPT
+{
+	if (this == &other)
+		return *this;
+	release();
+	m_data = other.m_data;
+	m_writable = other.m_writable;
+	other.m_data = 0;
+	other.m_writable = false;
+	updateAccess();
+	other.updateAccess();
+	return *this;
+}
+#endif
+
+template<typename T> void Utils::StaticVector<T>::release()
+{
+	Data* data = m_data;
+	const bool writable = m_writable;
+	m_data = 0;
+	m_writable = false;
+	updateAccess();
+	if (!data)
+		return;
+	//let other instances claim the write access
+	if (writable)
+		data->m_writeAccessClaimed.fetchAndStoreOrdered(0);
+	deref(data);
+}
+
+template<typename T> void Utils::StaticVector<T>::updateAccess()
+{
+	if (!m_data)
+		m_access = 0;
+	else if (m_writable)
+		m_access = m_data->m_base;
+	else
 	{
-		free(m_data->m_base);
-		delete m_data;
+#ifdef UTILS_STATICVECTOR_PAGE_PROTECTION
+		m_access = m_data->m_extension ? m_data->m_extension->m_readOnlyBase : 0;
+#else
+		m_access = 0;
+#endif
 	}
 }
 
-template<typename T> void Utils::StaticVector<T>::resize(int size)
+template<typename T> void Utils::StaticVector<T>::deref(Data* data)
 {
-	//detach from old data
-	if (m_data && --m_data->m_refCounter == 0)
+	//deref() is a full memory barrier, so all writes to the data by other threads are visible before it is freed
+	if (!data->m_refCounter.deref())
 	{
-		free(m_data->m_base);
-		delete m_data;
+#ifdef UTILS_STATICVECTOR_STATISTICS
+		Utils::StaticVectorStatistics::unregisterBuffer(data);
+#endif
+		const Storage storage = data->m_storage;
+		if (storage != MappedStorage && storage != SharedMemoryStorage) //these never contain complex types
+			destructElements(data->m_base, data->m_base + data->m_size);
+		if (Extension* extension = data->m_extension)
+		{
+#ifdef Q_OS_UNIX
+			munmap(extension->m_mapping, extension->m_mappingLength);
+			if (storage == ProtectedStorage)
+				munmap(extension->m_readOnlyBase, extension->m_mappingLength);
+			if (!extension->m_sharedMemoryName.isEmpty())
+				shm_unlink(extension->m_sharedMemoryName.constData());
+#endif
+			delete extension;
+		}
+		data->~Data();
+#ifdef Q_OS_WIN
+		if (storage == AlignedHeapStorage)
+		{
+			_aligned_free(data);
+			return;
+		}
+#else
+		Q_UNUSED(storage) //posix_memalign() memory is released with free()
+#endif
+		free(data); //for heap storage, this also frees the elements
 	}
+}
+
+template<typename T> size_t Utils::StaticVector<T>::payloadOffset(size_t alignment)
+{
+	//place the first element at the first correctly aligned position behind the header
+	return (sizeof(Data) + alignment - 1) / alignment * alignment;
+}
+
+template<typename T> void Utils::StaticVector<T>::constructElements(T* begin, T* end)
+{
+	//the condition is known at compile time, so primitive types do not even see the loop
+	//NOTE: "new T" instead of "new T()" leaves trivial types (e.g. POD structs without Q_DECLARE_TYPEINFO, if the type traits are not available) uninitialized
+	if (NeedsConstruction)
+		for (T* element = begin; element != end; ++element)
+			new (element) T;
+}
+
+template<typename T> void Utils::StaticVector<T>::destructElements(T* begin, T* end)
+{
+	if (NeedsDestruction)
+		for (T* element = begin; element != end; ++element)
+			element->~T();
+}
+
+template<typename T> void Utils::StaticVector<T>::resize(int size)
+{
+	resize(size, DefaultAlignment, NoAllocationHint);
+}
+
+template<typename T> void Utils::StaticVector<T>::resize(int size, int alignment, AllocationHint hint)
+{
+	Q_ASSERT((alignment & (alignment - 1)) == 0);
+	//detach from old data
+	release();
 	//create new data if necessary
 	if (size == 0)
 		m_data = 0;
 	else
 	{
-		m_data = new Data;
-		m_data->m_base = reinterpret_cast<T*>(malloc(size * sizeof(T)));
-		m_data->m_size = size;
-		m_data->m_writeAccessVector = this;
-		m_data->m_refCounter = 1; //this instance holds the only reference currently
+		//allocate header and elements at once to save an allocation and keep both in the same cache line (the header is only 32 bytes on 64-bit platforms, everything else lives in the Extension of non-heap storage)
+		const size_t payloadAlignment = qMax<size_t>(alignment, Q_ALIGNOF(T));
+		const size_t offset = payloadOffset(payloadAlignment);
+		size_t blockSize = offset + size * sizeof(T);
+		size_t blockAlignment = payloadAlignment;
+		if (hint == HugePageHint)
+		{
+			//huge pages can only be used for completely covered and aligned ranges
+			blockAlignment = qMax<size_t>(blockAlignment, HugePageSize);
+			blockSize = (blockSize + HugePageSize - 1) / HugePageSize * HugePageSize;
+		}
+		char* block;
+		Storage storage = HeapStorage;
+		if (blockAlignment <= 2 * sizeof(void*)) //malloc() guarantees at least this alignment on all major platforms
+			block = reinterpret_cast<char*>(malloc(blockSize));
+		else
+		{
+			storage = AlignedHeapStorage;
+#ifdef Q_OS_WIN
+			block = reinterpret_cast<char*>(_aligned_malloc(blockSize, blockAlignment));
+#else
+			void* alignedBlock;
+			block = posix_memalign(&alignedBlock, blockAlignment, blockSize) == 0 ? reinterpret_cast<char*>(alignedBlock) : 0;
+#endif
+		}
+		Q_CHECK_PTR(block);
+#if defined(Q_OS_LINUX) && defined(MADV_HUGEPAGE)
+		if (hint == HugePageHint)
+			madvise(block, blockSize, MADV_HUGEPAGE); //only a hint, so errors can be ignored
+#endif
+		m_data = new (block) Data(reinterpret_cast<T*>(block + offset), storage, size, true);
+		m_writable = true;
+		constructElements(m_data->m_base, m_data->m_base + size);
+#ifdef UTILS_STATICVECTOR_STATISTICS
+		registerData(m_data);
+#endif
+	}
+	updateAccess();
+}
+
+template<typename T> bool Utils::StaticVector<T>::resizeProtected(int size)
+{
+#ifdef Q_OS_UNIX
+	if (size <= 0)
+		return false;
+	//create an anonymous shared memory object, which can be mapped twice (unlike anonymous memory)
+#if defined(Q_OS_LINUX) && defined(MFD_CLOEXEC)
+	const int fd = ::memfd_create("staticvector", MFD_CLOEXEC);
+#else
+	static QAtomicInt objectCounter;
+	char objectName[64];
+	snprintf(objectName, sizeof(objectName), "/staticvector-%d-%d", int(getpid()), objectCounter.fetchAndAddOrdered(1));
+	const int fd = ::shm_open(objectName, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd != -1)
+		::shm_unlink(objectName); //the mappings keep the object alive
+#endif
+	if (fd == -1)
+		return false;
+	const size_t mappingLength = size_t(size) * sizeof(T);
+	void* mapping = MAP_FAILED;
+	void* readOnlyMapping = MAP_FAILED;
+	if (::ftruncate(fd, mappingLength) == 0)
+	{
+		mapping = ::mmap(0, mappingLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		readOnlyMapping = ::mmap(0, mappingLength, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	::close(fd); //the mappings hold their own references to the object
+	if (mapping == MAP_FAILED || readOnlyMapping == MAP_FAILED)
+	{
+		if (mapping != MAP_FAILED)
+			::munmap(mapping, mappingLength);
+		if (readOnlyMapping != MAP_FAILED)
+			::munmap(readOnlyMapping, mappingLength);
+		return false;
 	}
+	setMappedData(mapping, mappingLength, reinterpret_cast<T*>(mapping), ProtectedStorage, size, true);
+	m_data->m_extension->m_readOnlyBase = reinterpret_cast<T*>(readOnlyMapping);
+	constructElements(m_data->m_base, m_data->m_base + size);
+	updateAccess();
+	return true;
+#else
+	Q_UNUSED(size)
+	return false;
+#endif
 }
 
+template<typename T> bool Utils::StaticVector<T>::mapFile(const QString& fileName, MapMode mode, qint64 offset)
+{
+#ifdef Q_OS_UNIX
+	if (!IsPlainData || offset < 0 || offset % Q_ALIGNOF(T) != 0)
+		return false;
+	const int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY);
+	if (fd == -1)
+		return false;
+	struct stat fileInfo;
+	bool success = ::fstat(fd, &fileInfo) == 0 && offset < fileInfo.st_size;
+	if (success)
+	{
+		const int protection = mode == PrivateMapping ? PROT_READ | PROT_WRITE : PROT_READ;
+		success = mapDescriptor(fd, offset, (fileInfo.st_size - offset) / sizeof(T), protection, MAP_PRIVATE, MappedStorage, mode == PrivateMapping);
+	}
+	::close(fd); //the mapping holds its own reference to the file
+	return success;
+#else
+	Q_UNUSED(fileName) Q_UNUSED(mode) Q_UNUSED(offset)
+	return false;
+#endif
+}
+
+template<typename T> bool Utils::StaticVector<T>::createShared(const QString& name, int size)
+{
+#ifdef Q_OS_UNIX
+	if (!IsPlainData || size <= 0)
+		return false;
+	const QByteArray objectName = sharedMemoryObjectName(name);
+	const int fd = ::shm_open(objectName.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1)
+		return false;
+	bool success = ::ftruncate(fd, off_t(size) * sizeof(T)) == 0;
+	if (success)
+		success = mapDescriptor(fd, 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, SharedMemoryStorage, true);
+	::close(fd); //the mapping holds its own reference to the shared memory object
+	if (success)
+		m_data->m_extension->m_sharedMemoryName = objectName; //to remove the object when the data is released
+	else
+		::shm_unlink(objectName.constData());
+	return success;
+#else
+	Q_UNUSED(name) Q_UNUSED(size)
+	return false;
+#endif
+}
+
+template<typename T> bool Utils::StaticVector<T>::attachShared(const QString& name)
+{
+#ifdef Q_OS_UNIX
+	if (!IsPlainData)
+		return false;
+	const int fd = ::shm_open(sharedMemoryObjectName(name).constData(), O_RDONLY, 0);
+	if (fd == -1)
+		return false;
+	struct stat objectInfo;
+	bool success = ::fstat(fd, &objectInfo) == 0;
+	if (success)
+		success = mapDescriptor(fd, 0, objectInfo.st_size / sizeof(T), PROT_READ, MAP_SHARED, SharedMemoryStorage, false);
+	::close(fd);
+	return success;
+#else
+	Q_UNUSED(name)
+	return false;
+#endif
+}
+
+template<typename T> void Utils::StaticVector<T>::clear()
+{
+	release();
+}
+
+#ifdef Q_OS_UNIX
+template<typename T> bool Utils::StaticVector<T>::mapDescriptor(int fd, qint64 offset, qint64 size, int protection, int flags, Storage storage, bool writable)
+{
+	if (size <= 0 || size > INT_MAX)
+		return false;
+	//mmap() needs an offset which is a multiple of the page size
+	const qint64 pageSize = sysconf(_SC_PAGESIZE);
+	const qint64 mappingOffset = offset / pageSize * pageSize;
+	const size_t mappingLength = offset - mappingOffset + size * sizeof(T);
+	void* mapping = ::mmap(0, mappingLength, protection, flags, fd, mappingOffset);
+	if (mapping == MAP_FAILED)
+		return false;
+	T* base = reinterpret_cast<T*>(reinterpret_cast<char*>(mapping) + (offset - mappingOffset));
+	setMappedData(mapping, mappingLength, base, storage, size, writable);
+	if (!(protection & PROT_WRITE))
+		m_data->m_extension->m_readOnlyBase = base;
+	if (!writable)
+		m_data->m_writeAccessClaimed.fetchAndStoreOrdered(1); //nobody may ever claim write access to this read-only memory
+	updateAccess();
+	return true;
+}
+
+template<typename T> QByteArray Utils::StaticVector<T>::sharedMemoryObjectName(const QString& name)
+{
+	//POSIX requires portable names of shared memory objects to start with a slash
+	const QByteArray encodedName = QFile::encodeName(name);
+	return encodedName.startsWith('/') ? encodedName : '/' + encodedName;
+}
+#endif
+
+template<typename T> bool Utils::StaticVector<T>::reserve(int capacity)
+{
+#ifdef Q_OS_UNIX
+	if (capacity <= 0)
+		return false;
+	//reserve address space only; MAP_NORESERVE additionally avoids that the whole range is accounted against the overcommit limit
+	const size_t mappingLength = size_t(capacity) * sizeof(T);
+	void* mapping = ::mmap(0, mappingLength, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (mapping == MAP_FAILED)
+		return false;
+	setMappedData(mapping, mappingLength, reinterpret_cast<T*>(mapping), ReservedStorage, 0, true);
+	return true;
+#else
+	Q_UNUSED(capacity)
+	return false;
+#endif
+}
+
+template<typename T> bool Utils::StaticVector<T>::grow(int size)
+{
+	if (!isWritable() || m_data->m_storage != ReservedStorage)
+		return false;
+	if (size < m_data->m_size || size > capacity())
+		return false;
+#ifdef Q_OS_UNIX
+	//commit all pages that are touched by the new elements
+	const size_t requiredLength = size_t(size) * sizeof(T);
+	Extension* extension = m_data->m_extension;
+	if (requiredLength > extension->m_committedLength)
+	{
+		const size_t pageSize = sysconf(_SC_PAGESIZE);
+		const size_t committedLength = qMin((requiredLength + pageSize - 1) / pageSize * pageSize, extension->m_mappingLength);
+		char* mapping = reinterpret_cast<char*>(extension->m_mapping);
+		if (::mprotect(mapping + extension->m_committedLength, committedLength - extension->m_committedLength, PROT_READ | PROT_WRITE) != 0)
+			return false;
+		extension->m_committedLength = committedLength;
+	}
+#endif
+	constructElements(m_data->m_base + m_data->m_size, m_data->m_base + size);
+	m_data->m_size = size;
+#ifdef UTILS_STATICVECTOR_STATISTICS
+	Utils::StaticVectorStatistics::resizeBuffer(m_data, qint64(size) * sizeof(T));
+#endif
+	return true;
+}
+
+template<typename T> bool Utils::StaticVector<T>::append(const T& value)
+{
+	const int oldSize = size();
+	if (!grow(oldSize + 1))
+		return false;
+	m_data->m_base[oldSize] = value;
+	return true;
+}
+
+template<typename T> bool Utils::StaticVector<T>::isWritable() const
+{
+	return m_writable;
+}
+
+template<typename T> bool Utils::StaticVector<T>::isShared() const
+{
+	//fetchAndAddOrdered(0) is an atomic load that works with the QAtomicInt API of both Qt 4 and Qt 5
+	return m_data && const_cast<QAtomicInt&>(m_data->m_refCounter).fetchAndAddOrdered(0) > 1;
+}
+
+template<typename T> void Utils::StaticVector<T>::releaseWriteAccess()
+{
+	if (isWritable())
+	{
+		m_writable = false;
+		m_data->m_writeAccessClaimed.fetchAndStoreOrdered(0); //publishes all writes done so far to the next writer
+		updateAccess();
+	}
+}
+
+template<typename T> bool Utils::StaticVector<T>::takeWriteAccess()
+{
+	if (!m_data)
+		return false;
+	if (m_writable)
+		return true;
+	if (!m_data->m_writeAccessClaimed.testAndSetOrdered(0, 1))
+		return false;
+	m_writable = true;
+	updateAccess();
+	return true;
+}
+
+template<typename T> int Utils::StaticVector<T>::capacity() const
+{
+	if (m_data && m_data->m_storage == ReservedStorage)
+		return m_data->m_extension->m_mappingLength / sizeof(T);
+	return size();
+}
+
+template<typename T> void Utils::StaticVector<T>::setMappedData(void* mapping, size_t mappingLength, T* base, Storage storage, int size, bool writable)
+{
+	//replace old data
+	release();
+	void* header = malloc(sizeof(Data));
+	Q_CHECK_PTR(header);
+	m_data = new (header) Data(base, storage, size, writable);
+	m_writable = writable;
+	m_data->m_extension = new Extension(mapping, mappingLength);
+#ifdef UTILS_STATICVECTOR_STATISTICS
+	registerData(m_data);
+#endif
+	updateAccess();
+}
+
+#ifdef UTILS_STATICVECTOR_STATISTICS
+template<typename T> void Utils::StaticVector<T>::registerData(Data* data)
+{
+	Utils::StaticVectorStatistics::registerBuffer(data, typeid(T).name(), qint64(data->m_size) * sizeof(T), &inspectData);
+}
+
+template<typename T> void Utils::StaticVector<T>::inspectData(const void* data, int* refCount, bool* orphaned)
+{
+	Data* d = const_cast<Data*>(reinterpret_cast<const Data*>(data));
+	*refCount = d->m_refCounter.fetchAndAddOrdered(0);
+	//orphaned data has no writer, but could have one (in contrast to read-only mappings)
+	*orphaned = d->m_writeAccessClaimed.fetchAndAddOrdered(0) == 0;
+}
+#endif
+
 template<typename T> int Utils::StaticVector<T>::size() const
 {
 	return m_data ? m_data->m_size : 0;
@@ -174,10 +849,97 @@ template<typename T> T& Utils::StaticVector<T>::operator[](int i)
 {
 	Q_ASSERT(m_data);
 	Q_ASSERT(i >= 0 && i < m_data->m_size);
-	if (m_data->m_writeAccessVector == this)
-		return m_data->m_base[i];
+	//Without write access, m_access is either null or a read-only mapping (whose pages crash on writes). Indexing through the null pointer would not reliably fault for large i, so null is checked explicitly.
+	if (T* access = m_access)
+		return access[i];
 	else
 		return *((T*)0); //If no write access is allowed, fail loudly and early.
 }
 
+template<typename T> Utils::StaticVectorSlice<T> Utils::StaticVector<T>::mid(int pos, int length) const
+{
+	const int size = this->size();
+	pos = qBound(0, pos, size);
+	length = (length < 0 || length > size - pos) ? size - pos : length;
+	if (length == 0)
+		return Utils::StaticVectorSlice<T>();
+	return Utils::StaticVectorSlice<T>(m_data, pos, length);
+}
+
+template<typename T> Utils::StaticVectorSlice<T>::StaticVectorSlice()
+	: m_data(0)
+	, m_offset(0)
+	, m_size(0)
+{
+}
+
+template<typename T> Utils::StaticVectorSlice<T>::StaticVectorSlice(Data* data, int offset, int size)
+	: m_data(data)
+	, m_offset(offset)
+	, m_size(size)
+{
+	m_data->m_refCounter.ref();
+}
+
+template<typename T> Utils::StaticVectorSlice<T>::StaticVectorSlice(const Utils::StaticVectorSlice<T>& other)
+	: m_data(other.m_data)
+	, m_offset(other.m_offset)
+	, m_size(other.m_size)
+{
+	if (m_data)
+		m_data->m_refCounter.ref();
+}
+
+template<typename T> Utils::StaticVectorSlice<T>::~StaticVectorSlice()
+{
+	if (m_data)
+		Utils::StaticVector<T>::deref(m_data);
+}
+
+template<typename T> Utils::StaticVectorSlice<T>& Utils::StaticVectorSlice<T>::operator=(const Utils::StaticVectorSlice<T>& other)
+{
+	if (other.m_data)
+		other.m_data->m_refCounter.ref();
+	if (m_data)
+		Utils::StaticVector<T>::deref(m_data);
+	m_data = other.m_data;
+	m_offset = other.m_offset;
+	m_size = other.m_size;
+	return *this;
+}
+
+template<typename T> int Utils::StaticVectorSlice<T>::size() const
+{
+	return m_size;
+}
+
+template<typename T> int Utils::StaticVectorSlice<T>::count() const
+{
+	return m_size;
+}
+
+template<typename T> T* Utils::StaticVectorSlice<T>::data() const
+{
+	return m_data ? m_data->m_base + m_offset : 0;
+}
+
+template<typename T> T Utils::StaticVectorSlice<T>::value(int i, const T& defaultValue) const
+{
+	if (i < 0 || i >= m_size)
+		return defaultValue;
+	return m_data->m_base[m_offset + i];
+}
+
+template<typename T> const T& Utils::StaticVectorSlice<T>::at(int i) const
+{
+	Q_ASSERT(m_data);
+	Q_ASSERT(i >= 0 && i < m_size);
+	return m_data->m_base[m_offset + i];
+}
+
+template<typename T> int Utils::StaticVectorSlice<T>::offset() const
+{
+	return m_offset;
+}
+
 #endif //UTILS_STATICVECTOR_H
@@ -0,0 +1,410 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+#ifndef UTILS_STATICVECTORALGORITHMS_H
+#define UTILS_STATICVECTORALGORITHMS_H
+
+#include "staticvector.h"
+
+#include <cstring>
+
+//SSE2 is part of every x86-64 CPU; AVX2 is selected at runtime (only with compilers that support function multiversioning)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define UTILS_STATICVECTOR_SSE2
+#	include <emmintrin.h>
+#endif
+#if defined(UTILS_STATICVECTOR_SSE2) && defined(Q_CC_GNU) && (defined(__x86_64__) || defined(__i386__))
+#	define UTILS_STATICVECTOR_AVX2
+#	include <immintrin.h>
+#endif
+
+namespace Utils
+{
+	/**
+	 * \namespace StaticVectorAlgorithms
+	 *
+	 * Bulk operations on the whole data of a StaticVector. They work directly on the data pointer, so the write access is checked only once per call instead of once per element (as with StaticVector::operator[]).
+	 *
+	 * For StaticVector<float> and StaticVector<int>, the operations are vectorized with SSE2 and (if the CPU supports it, which is checked at runtime) AVX2. All other types use plain loops.
+	 *
+	 * \note The vectorized sum() adds the elements in a different order than a plain loop, so the result for floats may differ in the last bits.
+	 */
+	namespace StaticVectorAlgorithms
+	{
+		///Sets all elements of \a vector to \a value.
+		///\return false if \a vector does not have write access to its data
+		template<typename T> inline bool fill(Utils::StaticVector<T>& vector, const T& value);
+		///Copies \a count elements from \a source to \a vector, starting at index \a offset in \a vector.
+		///\return false if \a vector does not have write access to its data, or if the elements do not fit
+		template<typename T> inline bool copyFrom(Utils::StaticVector<T>& vector, const T* source, int count, int offset = 0);
+		///Multiplies all elements of \a vector with \a factor.
+		///\return false if \a vector does not have write access to its data
+		template<typename T> inline bool scale(Utils::StaticVector<T>& vector, const T& factor);
+		///Returns the sum of all elements of \a vector, or T() if \a vector is empty.
+		template<typename T> inline T sum(const Utils::StaticVector<T>& vector);
+		///Returns the smallest element of \a vector, or T() if \a vector is empty.
+		template<typename T> inline T minimum(const Utils::StaticVector<T>& vector);
+		///Returns the largest element of \a vector, or T() if \a vector is empty.
+		template<typename T> inline T maximum(const Utils::StaticVector<T>& vector);
+	}
+
+	//The kernels which do the actual work. The generic templates are used for all types, and are overloaded for float and int where SIMD is available.
+	namespace StaticVectorKernels
+	{
+		template<typename T> inline void fillScalar(T* data, int size, T value)
+		{
+			for (int i = 0; i < size; ++i)
+				data[i] = value;
+		}
+		template<typename T> inline void scaleScalar(T* data, int size, T factor)
+		{
+			for (int i = 0; i < size; ++i)
+				data[i] *= factor;
+		}
+		template<typename T> inline T sumScalar(const T* data, int size)
+		{
+			T result = T();
+			for (int i = 0; i < size; ++i)
+				result += data[i];
+			return result;
+		}
+		//minimumScalar() and maximumScalar() take an initial value, so that they can also reduce tails of the SIMD kernels
+		template<typename T> inline T minimumScalar(const T* data, int size, T result)
+		{
+			for (int i = 0; i < size; ++i)
+				if (data[i] < result)
+					result = data[i];
+			return result;
+		}
+		template<typename T> inline T maximumScalar(const T* data, int size, T result)
+		{
+			for (int i = 0; i < size; ++i)
+				if (result < data[i])
+					result = data[i];
+			return result;
+		}
+
+		template<typename T> inline void fill(T* data, int size, T value) { fillScalar(data, size, value); }
+		template<typename T> inline void scale(T* data, int size, T factor) { scaleScalar(data, size, factor); }
+		template<typename T> inline T sum(const T* data, int size) { return sumScalar(data, size); }
+		template<typename T> inline T minimum(const T* data, int size) { return minimumScalar(data + 1, size - 1, data[0]); }
+		template<typename T> inline T maximum(const T* data, int size) { return maximumScalar(data + 1, size - 1, data[0]); }
+
+#ifdef UTILS_STATICVECTOR_AVX2
+		inline bool hasAvx2()
+		{
+			static const bool result = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+			return result;
+		}
+
+		__attribute__((target("avx2"))) inline void fillAvx2(float* data, int size, float value)
+		{
+			const __m256 v = _mm256_set1_ps(value);
+			int i = 0;
+			for (; i + 8 <= size; i += 8)
+				_mm256_storeu_ps(data + i, v);
+			fillScalar(data + i, size - i, value);
+		}
+		__attribute__((target("avx2"))) inline void fillAvx2(int* data, int size, int value)
+		{
+			const __m256i v = _mm256_set1_epi32(value);
+			int i = 0;
+			for (; i + 8 <= size; i += 8)
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), v);
+			fillScalar(data + i, size - i, value);
+		}
+		__attribute__((target("avx2"))) inline void scaleAvx2(float* data, int size, float factor)
+		{
+			const __m256 f = _mm256_set1_ps(factor);
+			int i = 0;
+			for (; i + 8 <= size; i += 8)
+				_mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), f));
+			scaleScalar(data + i, size - i, factor);
+		}
+		__attribute__((target("avx2"))) inline void scaleAvx2(int* data, int size, int factor)
+		{
+			const __m256i f = _mm256_set1_epi32(factor);
+			int i = 0;
+			for (; i + 8 <= size; i += 8)
+			{
+				__m256i* p = reinterpret_cast<__m256i*>(data + i);
+				_mm256_storeu_si256(p, _mm256_mullo_epi32(_mm256_loadu_si256(p), f));
+			}
+			scaleScalar(data + i, size - i, factor);
+		}
+		__attribute__((target("avx2"))) inline float sumAvx2(const float* data, int size)
+		{
+			//two accumulators to hide the latency of the additions
+			__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+			int i = 0;
+			for (; i + 16 <= size; i += 16)
+			{
+				acc0 = _mm256_add_ps(acc0, _mm256_loadu_ps(data + i));
+				acc1 = _mm256_add_ps(acc1, _mm256_loadu_ps(data + i + 8));
+			}
+			float lanes[8];
+			_mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+			return sumScalar(lanes, 8) + sumScalar(data + i, size - i);
+		}
+		__attribute__((target("avx2"))) inline int sumAvx2(const int* data, int size)
+		{
+			__m256i acc = _mm256_setzero_si256();
+			int i = 0;
+			for (; i + 8 <= size; i += 8)
+				acc = _mm256_add_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+			int lanes[8];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+			return sumScalar(lanes, 8) + sumScalar(data + i, size - i);
+		}
+		__attribute__((target("avx2"))) inline float minimumAvx2(const float* data, int size)
+		{
+			if (size < 8)
+				return minimumScalar(data + 1, size - 1, data[0]);
+			__m256 acc = _mm256_loadu_ps(data);
+			int i = 8;
+			for (; i + 8 <= size; i += 8)
+				acc = _mm256_min_ps(acc, _mm256_loadu_ps(data + i));
+			float lanes[8];
+			_mm256_storeu_ps(lanes, acc);
+			return minimumScalar(data + i, size - i, minimumScalar(lanes + 1, 7, lanes[0]));
+		}
+		__attribute__((target("avx2"))) inline int minimumAvx2(const int* data, int size)
+		{
+			if (size < 8)
+				return minimumScalar(data + 1, size - 1, data[0]);
+			__m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+			int i = 8;
+			for (; i + 8 <= size; i += 8)
+				acc = _mm256_min_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+			int lanes[8];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+			return minimumScalar(data + i, size - i, minimumScalar(lanes + 1, 7, lanes[0]));
+		}
+		__attribute__((target("avx2"))) inline float maximumAvx2(const float* data, int size)
+		{
+			if (size < 8)
+				return maximumScalar(data + 1, size - 1, data[0]);
+			__m256 acc = _mm256_loadu_ps(data);
+			int i = 8;
+			for (; i + 8 <= size; i += 8)
+				acc = _mm256_max_ps(acc, _mm256_loadu_ps(data + i));
+			float lanes[8];
+			_mm256_storeu_ps(lanes, acc);
+			return maximumScalar(data + i, size - i, maximumScalar(lanes + 1, 7, lanes[0]));
+		}
+		__attribute__((target("avx2"))) inline int maximumAvx2(const int* data, int size)
+		{
+			if (size < 8)
+				return maximumScalar(data + 1, size - 1, data[0]);
+			__m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+			int i = 8;
+			for (; i + 8 <= size; i += 8)
+				acc = _mm256_max_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+			int lanes[8];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+			return maximumScalar(data + i, size - i, maximumScalar(lanes + 1, 7, lanes[0]));
+		}
+#	define UTILS_STATICVECTOR_DISPATCH_AVX2(function, ...) \
+			if (hasAvx2()) \
+				return function##Avx2(__VA_ARGS__);
+#else
+#	define UTILS_STATICVECTOR_DISPATCH_AVX2(function, ...)
+#endif
+
+#ifdef UTILS_STATICVECTOR_SSE2
+		//SSE2 lacks min/max for 32-bit integers (emulated here) and a 32-bit integer multiplication (left to the scalar kernel)
+		inline __m128i minEpi32Sse2(__m128i a, __m128i b)
+		{
+			const __m128i aIsLess = _mm_cmplt_epi32(a, b);
+			return _mm_or_si128(_mm_and_si128(aIsLess, a), _mm_andnot_si128(aIsLess, b));
+		}
+		inline __m128i maxEpi32Sse2(__m128i a, __m128i b)
+		{
+			const __m128i aIsGreater = _mm_cmpgt_epi32(a, b);
+			return _mm_or_si128(_mm_and_si128(aIsGreater, a), _mm_andnot_si128(aIsGreater, b));
+		}
+
+		inline void fill(float* data, int size, float value)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(fill, data, size, value)
+			const __m128 v = _mm_set1_ps(value);
+			int i = 0;
+			for (; i + 4 <= size; i += 4)
+				_mm_storeu_ps(data + i, v);
+			fillScalar(data + i, size - i, value);
+		}
+		inline void fill(int* data, int size, int value)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(fill, data, size, value)
+			const __m128i v = _mm_set1_epi32(value);
+			int i = 0;
+			for (; i + 4 <= size; i += 4)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), v);
+			fillScalar(data + i, size - i, value);
+		}
+		inline void scale(float* data, int size, float factor)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(scale, data, size, factor)
+			const __m128 f = _mm_set1_ps(factor);
+			int i = 0;
+			for (; i + 4 <= size; i += 4)
+				_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), f));
+			scaleScalar(data + i, size - i, factor);
+		}
+		inline void scale(int* data, int size, int factor)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(scale, data, size, factor)
+			scaleScalar(data, size, factor);
+		}
+		inline float sum(const float* data, int size)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(sum, data, size)
+			__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+			int i = 0;
+			for (; i + 8 <= size; i += 8)
+			{
+				acc0 = _mm_add_ps(acc0, _mm_loadu_ps(data + i));
+				acc1 = _mm_add_ps(acc1, _mm_loadu_ps(data + i + 4));
+			}
+			float lanes[4];
+			_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+			return sumScalar(lanes, 4) + sumScalar(data + i, size - i);
+		}
+		inline int sum(const int* data, int size)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(sum, data, size)
+			__m128i acc = _mm_setzero_si128();
+			int i = 0;
+			for (; i + 4 <= size; i += 4)
+				acc = _mm_add_epi32(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+			int lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+			return sumScalar(lanes, 4) + sumScalar(data + i, size - i);
+		}
+		inline float minimum(const float* data, int size)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(minimum, data, size)
+			if (size < 4)
+				return minimumScalar(data + 1, size - 1, data[0]);
+			__m128 acc = _mm_loadu_ps(data);
+			int i = 4;
+			for (; i + 4 <= size; i += 4)
+				acc = _mm_min_ps(acc, _mm_loadu_ps(data + i));
+			float lanes[4];
+			_mm_storeu_ps(lanes, acc);
+			return minimumScalar(data + i, size - i, minimumScalar(lanes + 1, 3, lanes[0]));
+		}
+		inline int minimum(const int* data, int size)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(minimum, data, size)
+			if (size < 4)
+				return minimumScalar(data + 1, size - 1, data[0]);
+			__m128i acc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+			int i = 4;
+			for (; i + 4 <= size; i += 4)
+				acc = minEpi32Sse2(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+			int lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+			return minimumScalar(data + i, size - i, minimumScalar(lanes + 1, 3, lanes[0]));
+		}
+		inline float maximum(const float* data, int size)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(maximum, data, size)
+			if (size < 4)
+				return maximumScalar(data + 1, size - 1, data[0]);
+			__m128 acc = _mm_loadu_ps(data);
+			int i = 4;
+			for (; i + 4 <= size; i += 4)
+				acc = _mm_max_ps(acc, _mm_loadu_ps(data + i));
+			float lanes[4];
+			_mm_storeu_ps(lanes, acc);
+			return maximumScalar(data + i, size - i, maximumScalar(lanes + 1, 3, lanes[0]));
+		}
+		inline int maximum(const int* data, int size)
+		{
+			UTILS_STATICVECTOR_DISPATCH_AVX2(maximum, data, size)
+			if (size < 4)
+				return maximumScalar(data + 1, size - 1, data[0]);
+			__m128i acc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+			int i = 4;
+			for (; i + 4 <= size; i += 4)
+				acc = maxEpi32Sse2(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+			int lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+			return maximumScalar(data + i, size - i, maximumScalar(lanes + 1, 3, lanes[0]));
+		}
+#endif
+#undef UTILS_STATICVECTOR_DISPATCH_AVX2
+	}
+}
+
+template<typename T> bool Utils::StaticVectorAlgorithms::fill(Utils::StaticVector<T>& vector, const T& value)
+{
+	if (!vector.isWritable())
+		return false;
+	Utils::StaticVectorKernels::fill(vector.data(), vector.size(), value);
+	return true;
+}
+
+template<typename T> bool Utils::StaticVectorAlgorithms::copyFrom(Utils::StaticVector<T>& vector, const T* source, int count, int offset)
+{
+	if (!vector.isWritable() || count < 0 || offset < 0 || offset + count > vector.size())
+		return false;
+	T* target = vector.data() + offset;
+	if (QTypeInfo<T>::isComplex)
+	{
+		for (int i = 0; i < count; ++i)
+			target[i] = source[i];
+	}
+	else
+		memcpy(target, source, count * sizeof(T)); //already as vectorized as it gets
+	return true;
+}
+
+template<typename T> bool Utils::StaticVectorAlgorithms::scale(Utils::StaticVector<T>& vector, const T& factor)
+{
+	if (!vector.isWritable())
+		return false;
+	Utils::StaticVectorKernels::scale(vector.data(), vector.size(), factor);
+	return true;
+}
+
+template<typename T> T Utils::StaticVectorAlgorithms::sum(const Utils::StaticVector<T>& vector)
+{
+	return Utils::StaticVectorKernels::sum(vector.data(), vector.size());
+}
+
+template<typename T> T Utils::StaticVectorAlgorithms::minimum(const Utils::StaticVector<T>& vector)
+{
+	if (vector.size() == 0)
+		return T();
+	return Utils::StaticVectorKernels::minimum(vector.data(), vector.size());
+}
+
+template<typename T> T Utils::StaticVectorAlgorithms::maximum(const Utils::StaticVector<T>& vector)
+{
+	if (vector.size() == 0)
+		return T();
+	return Utils::StaticVectorKernels::maximum(vector.data(), vector.size());
+}
+
+#endif //UTILS_STATICVECTORALGORITHMS_H
@@ -0,0 +1,338 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+//Microbenchmarks for Utils::StaticVector and its companion containers. Each benchmark prints the time per operation. Pass the names of benchmarks as arguments to run only these (e.g. "staticvectorbench allocation").
+
+#include "staticvector.h"
+#include "staticvectoralgorithms.h"
+#include "staticsoa.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
+#include <cstdio>
+#include <cstring>
+
+static volatile qint64 sink; //keeps the compiler from optimizing the measured loops away
+
+static void report(const char* name, const QElapsedTimer& timer, qint64 operations)
+{
+	printf("  %-48s %10.2f ns/op\n", name, double(timer.nsecsElapsed()) / operations);
+}
+
+//BEGIN allocation
+
+//The layout of StaticVector before the header and the elements were allocated in one block, for comparison.
+template<typename T> class TwoBlockVector
+{
+	public:
+		TwoBlockVector() : m_data(0) {}
+		TwoBlockVector(const TwoBlockVector<T>& other) : m_data(other.m_data) { if (m_data) m_data->m_refCounter.ref(); }
+		~TwoBlockVector() { release(); }
+		void resize(int size)
+		{
+			release();
+			m_data = new Data;
+			m_data->m_base = reinterpret_cast<T*>(malloc(size * sizeof(T)));
+			m_data->m_size = size;
+			m_data->m_refCounter = 1;
+		}
+		const T& at(int i) const { return m_data->m_base[i]; }
+		T* data() const { return m_data->m_base; }
+	private:
+		struct Data
+		{
+			T* m_base;
+			int m_size;
+			QAtomicInt m_refCounter;
+		};
+		void release()
+		{
+			if (m_data && !m_data->m_refCounter.deref())
+			{
+				free(m_data->m_base);
+				delete m_data;
+			}
+			m_data = 0;
+		}
+		TwoBlockVector<T>& operator=(const TwoBlockVector<T>&);
+		Data* m_data;
+};
+
+template<typename Vector> static void benchmarkAllocation(const char* layout)
+{
+	enum { VectorCount = 4096, VectorSize = 16, Rounds = 256 };
+	Vector* vectors = new Vector[VectorCount];
+	char name[64];
+	QElapsedTimer timer;
+	//resize() of many small vectors (the old data is released in the next round)
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < VectorCount; ++i)
+			vectors[i].resize(VectorSize);
+	snprintf(name, sizeof(name), "%s: resize(%d)", layout, int(VectorSize));
+	report(name, timer, qint64(Rounds) * VectorCount);
+	for (int i = 0; i < VectorCount; ++i)
+		memset(vectors[i].data(), 0, VectorSize * sizeof(int));
+	//copy and destruction of read-only copies
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < VectorCount; ++i)
+		{
+			const Vector copy(vectors[i]);
+			sink += copy.at(0);
+		}
+	snprintf(name, sizeof(name), "%s: copy", layout);
+	report(name, timer, qint64(Rounds) * VectorCount);
+	//element access, scattered over all vectors (which is where the additional pointer chase hurts)
+	qint64 sum = 0;
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < VectorCount; ++i)
+			for (int j = 0; j < VectorSize; ++j)
+				sum += vectors[(i * 7919 + j) % VectorCount].at(j);
+	sink += sum;
+	snprintf(name, sizeof(name), "%s: at()", layout);
+	report(name, timer, qint64(Rounds) * VectorCount * VectorSize);
+	delete[] vectors;
+}
+
+static void benchmarkAllocation()
+{
+	printf("allocation (two blocks before, one block now):\n");
+	benchmarkAllocation<TwoBlockVector<int> >("two blocks");
+	benchmarkAllocation<Utils::StaticVector<int> >("one block");
+}
+
+//END allocation
+
+//BEGIN simd
+
+template<typename T> static void benchmarkSimd(const char* type)
+{
+	enum { VectorSize = 1 << 20, Rounds = 64 };
+	Utils::StaticVector<T> vector;
+	vector.resize(VectorSize);
+	for (int i = 0; i < VectorSize; ++i)
+		vector[i] = T(i % 1000);
+	const T* data = vector.data();
+	char name[64];
+	QElapsedTimer timer;
+	//sum(): plain element loop, scalar kernel, dispatched SIMD kernel
+	T result = 0;
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < VectorSize; ++i)
+			result += vector.at(i);
+	snprintf(name, sizeof(name), "%s: sum, element loop", type);
+	report(name, timer, qint64(Rounds) * VectorSize);
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		result += Utils::StaticVectorKernels::sumScalar(data, int(VectorSize));
+	snprintf(name, sizeof(name), "%s: sum, scalar kernel", type);
+	report(name, timer, qint64(Rounds) * VectorSize);
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		result += Utils::StaticVectorAlgorithms::sum(vector);
+	snprintf(name, sizeof(name), "%s: sum, SIMD kernel", type);
+	report(name, timer, qint64(Rounds) * VectorSize);
+	//maximum()
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		result += Utils::StaticVectorKernels::maximumScalar(data + 1, int(VectorSize) - 1, data[0]);
+	snprintf(name, sizeof(name), "%s: maximum, scalar kernel", type);
+	report(name, timer, qint64(Rounds) * VectorSize);
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		result += Utils::StaticVectorAlgorithms::maximum(vector);
+	snprintf(name, sizeof(name), "%s: maximum, SIMD kernel", type);
+	report(name, timer, qint64(Rounds) * VectorSize);
+	sink += qint64(result);
+	//scale() (factor 1 keeps the values stable over all rounds; it is volatile so that the compiler cannot drop the loop)
+	volatile T volatileFactor = T(1);
+	const T factor = volatileFactor;
+	T* mutableData = vector.data();
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		Utils::StaticVectorKernels::scaleScalar(mutableData, int(VectorSize), factor);
+	snprintf(name, sizeof(name), "%s: scale, scalar kernel", type);
+	report(name, timer, qint64(Rounds) * VectorSize);
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		Utils::StaticVectorAlgorithms::scale(vector, factor);
+	snprintf(name, sizeof(name), "%s: scale, SIMD kernel", type);
+	report(name, timer, qint64(Rounds) * VectorSize);
+	sink += qint64(vector.at(VectorSize - 1));
+}
+
+static void benchmarkSimd()
+{
+#if defined(UTILS_STATICVECTOR_AVX2)
+	printf("simd (SIMD kernels: %s):\n", Utils::StaticVectorKernels::hasAvx2() ? "AVX2" : "SSE2");
+#elif defined(UTILS_STATICVECTOR_SSE2)
+	printf("simd (SIMD kernels: SSE2):\n");
+#else
+	printf("simd (no SIMD kernels available, both variants are scalar):\n");
+#endif
+	benchmarkSimd<float>("float");
+	benchmarkSimd<int>("int");
+}
+
+//END simd
+
+//BEGIN soa
+
+struct Particle
+{
+	float position[3];
+	float velocity[3];
+	float mass;
+	float charge;
+};
+
+static void benchmarkSoA()
+{
+	enum { RecordCount = 1 << 20, Rounds = 64 };
+	enum { Position, Velocity, Mass, Charge };
+	printf("soa (array of structs vs. struct of arrays):\n");
+	Utils::StaticVector<Particle> aos;
+	aos.resize(RecordCount);
+	Utils::StaticSoA<float, float, float, float> soa; //position and velocity are reduced to their x component
+	soa.resize(RecordCount);
+	float* positions = soa.data<Position>();
+	float* velocities = soa.data<Velocity>();
+	float* masses = soa.data<Mass>();
+	for (int i = 0; i < RecordCount; ++i)
+	{
+		Particle& particle = aos[i];
+		for (int d = 0; d < 3; ++d)
+			particle.position[d] = particle.velocity[d] = float(i % 100);
+		particle.mass = particle.charge = float(i % 10);
+		positions[i] = velocities[i] = float(i % 100);
+		masses[i] = soa.element<Charge>(i) = float(i % 10);
+	}
+	QElapsedTimer timer;
+	//a loop which reads only one field
+	float total = 0;
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < RecordCount; ++i)
+			total += aos.at(i).mass;
+	report("AoS: sum of one field", timer, qint64(Rounds) * RecordCount);
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < RecordCount; ++i)
+			total += masses[i];
+	report("SoA: sum of one field", timer, qint64(Rounds) * RecordCount);
+	//a loop which updates one field from another
+	const Particle* particles = aos.data();
+	Particle* mutableParticles = aos.data();
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < RecordCount; ++i)
+			mutableParticles[i].position[0] += particles[i].velocity[0] * 0.001f;
+	report("AoS: update of one field", timer, qint64(Rounds) * RecordCount);
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < RecordCount; ++i)
+			positions[i] += velocities[i] * 0.001f;
+	report("SoA: update of one field", timer, qint64(Rounds) * RecordCount);
+	sink += qint64(total + aos.at(RecordCount - 1).position[0] + soa.at<Position>(RecordCount - 1));
+}
+
+//END soa
+
+//BEGIN access
+
+#ifdef Q_CC_GNU
+#	define BENCHMARK_NOINLINE __attribute__((noinline))
+#else
+#	define BENCHMARK_NOINLINE
+#endif
+
+BENCHMARK_NOINLINE static void writeElement(Utils::StaticVector<int>& vector, int index, int value)
+{
+	vector[index] += value;
+}
+
+BENCHMARK_NOINLINE static void writeData(int* data, int index, int value)
+{
+	data[index] += value;
+}
+
+static void benchmarkAccess()
+{
+	enum { VectorSize = 1 << 16, Rounds = 2048 };
+	printf("access (operator[] checks for a null access pointer, data() has no branch):\n");
+	Utils::StaticVector<int> vector;
+	vector.resize(VectorSize);
+	int* data = vector.data();
+	memset(data, 0, VectorSize * sizeof(int));
+	QElapsedTimer timer;
+	//scattered writes, so that the compiler cannot vectorize the loop (but it may still hoist the check out of the loop)
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < VectorSize; ++i)
+			vector[(i * 7919) & (VectorSize - 1)] += round;
+	report("operator[] (with branch)", timer, qint64(Rounds) * VectorSize);
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < VectorSize; ++i)
+			data[(i * 7919) & (VectorSize - 1)] += round;
+	report("data() (without branch)", timer, qint64(Rounds) * VectorSize);
+	//calls which are not inlined into a loop have to do the check every time
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < VectorSize; ++i)
+			writeElement(vector, (i * 7919) & (VectorSize - 1), round);
+	report("operator[] (with branch, not inlined)", timer, qint64(Rounds) * VectorSize);
+	timer.start();
+	for (int round = 0; round < Rounds; ++round)
+		for (int i = 0; i < VectorSize; ++i)
+			writeData(data, (i * 7919) & (VectorSize - 1), round);
+	report("data() (without branch, not inlined)", timer, qint64(Rounds) * VectorSize);
+	sink += vector.at(VectorSize - 1);
+}
+
+//END access
+
+static bool isSelected(int argc, char** argv, const char* name)
+{
+	if (argc < 2)
+		return true;
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], name) == 0)
+			return true;
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	if (isSelected(argc, argv, "allocation"))
+		benchmarkAllocation();
+	if (isSelected(argc, argv, "simd"))
+		benchmarkSimd();
+	if (isSelected(argc, argv, "soa"))
+		benchmarkSoA();
+	if (isSelected(argc, argv, "access"))
+		benchmarkAccess();
+	return 0;
+}
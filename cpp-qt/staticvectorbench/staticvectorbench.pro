@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = staticvectorbench
+CONFIG += console thread release
+CONFIG -= app_bundle
+QT -= gui
+#StaticSoA needs variadic templates
+greaterThan(QT_MAJOR_VERSION, 4): CONFIG += c++11
+else: QMAKE_CXXFLAGS += -std=c++0x
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+
+# Input
+HEADERS += ../staticvector.h ../staticvectoralgorithms.h ../staticsoa.h
+SOURCES += benchmark.cpp
@@ -0,0 +1,182 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+#ifndef UTILS_STATICVECTORPARALLEL_H
+#define UTILS_STATICVECTORPARALLEL_H
+
+#include "staticvectoralgorithms.h"
+
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThreadPool>
+
+namespace Utils
+{
+	/**
+	 * \namespace StaticVectorParallel
+	 *
+	 * Bulk operations that split the data of a StaticVector into chunks, which are processed concurrently by the threads of a QThreadPool (the global one by default). The calling thread processes one of the chunks itself, and returns when all chunks are done.
+	 *
+	 * Besides the speedup, this matters for the placement of the memory on NUMA machines: StaticVector::resize() does not initialize the elements of POD types, so the operating system will place each page of a freshly allocated vector on the NUMA node of the thread that touches it first. Initializing a large vector with one of these functions therefore spreads its pages across the nodes of all threads in the pool, instead of putting them all on the node of one thread:
+\code
+Utils::StaticVector<float> samples;
+samples.resize(1 << 28);
+Utils::StaticVectorParallel::fill(samples, 0.0f);
+\endcode
+	 * The chunk boundaries are aligned to pages, so each page is touched by exactly one thread (except if the size of T does not divide the page size). Vectors that span only a few pages are processed by the calling thread alone.
+	 *
+	 * \warning The calling thread blocks until the chunks in the pool are done. Do not call these functions from a thread of the same pool if all other threads of the pool might be blocked as well.
+	 */
+	namespace StaticVectorParallel
+	{
+		///Sets all elements of \a vector to \a value.
+		///\return false if \a vector does not have write access to its data
+		template<typename T> inline bool fill(Utils::StaticVector<T>& vector, const T& value, QThreadPool* pool = 0);
+		///Sets each element of \a vector to \a generator(i), where i is the index of the element. The generator is copied for each chunk, and its copies are called concurrently.
+		///\return false if \a vector does not have write access to its data
+		template<typename T, typename Generator> inline bool generate(Utils::StaticVector<T>& vector, Generator generator, QThreadPool* pool = 0);
+		///Sets each element of \a vector to \a function(source[i]), where i is the index of the element. The function is copied for each chunk, and its copies are called concurrently. \a source may be a read-only copy of \a vector (to transform the elements in place).
+		///\return false if \a vector does not have write access to its data, or if \a source has a different size
+		template<typename T, typename U, typename Function> inline bool transform(Utils::StaticVector<T>& vector, const Utils::StaticVector<U>& source, Function function, QThreadPool* pool = 0);
+	}
+
+	namespace StaticVectorKernels
+	{
+		//Each job processes the elements [begin, end) of its data.
+		template<typename T> struct FillJob
+		{
+			T* data;
+			T value;
+			inline void operator()(int begin, int end) const { fill(data + begin, end - begin, value); }
+		};
+		template<typename T, typename Generator> struct GenerateJob
+		{
+			T* data;
+			Generator generator;
+			inline void operator()(int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
+					data[i] = generator(i);
+			}
+		};
+		template<typename T, typename U, typename Function> struct TransformJob
+		{
+			T* data;
+			const U* source;
+			Function function;
+			inline void operator()(int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
+					data[i] = function(source[i]);
+			}
+		};
+
+		template<typename Job> class ParallelRunnable : public QRunnable
+		{
+			public:
+				ParallelRunnable(const Job& job, int begin, int end, QSemaphore* done) : m_job(job), m_begin(begin), m_end(end), m_done(done) { setAutoDelete(true); }
+				virtual void run()
+				{
+					m_job(m_begin, m_end);
+					m_done->release();
+				}
+			private:
+				Job m_job;
+				int m_begin, m_end;
+				QSemaphore* m_done;
+		};
+
+		inline size_t pageSize()
+		{
+#ifdef Q_OS_UNIX
+			static const size_t result = sysconf(_SC_PAGESIZE);
+			return result;
+#else
+			return 4096;
+#endif
+		}
+
+		//Runs the job on the elements [0, size) of data, split into page-aligned chunks.
+		template<typename T, typename Job> inline void runParallel(const T* data, int size, const Job& job, QThreadPool* pool)
+		{
+			enum { MinimumChunkPages = 16 }; //smaller chunks are not worth the overhead of a thread switch
+			if (!pool)
+				pool = QThreadPool::globalInstance();
+			const size_t page = pageSize();
+			const size_t bytes = size_t(size) * sizeof(T);
+			const int chunkCount = int(qMin(size_t(qMax(pool->maxThreadCount(), 1)), bytes / (page * MinimumChunkPages)));
+			Job localJob(job);
+			if (chunkCount <= 1)
+			{
+				localJob(0, size);
+				return;
+			}
+			//chunk boundaries are computed in bytes relative to the first page (which need not be the first element), rounded to pages, and converted back to element indexes
+			const quintptr firstPage = quintptr(data) / page * page;
+			const size_t totalPages = (quintptr(data) + bytes - firstPage + page - 1) / page;
+			QSemaphore done;
+			int begin = 0;
+			for (int chunk = 1; chunk < chunkCount; ++chunk)
+			{
+				const quintptr boundary = firstPage + totalPages * chunk / chunkCount * page;
+				const int end = int((boundary - quintptr(data) + sizeof(T) - 1) / sizeof(T));
+				if (end > begin)
+					pool->start(new ParallelRunnable<Job>(job, begin, end, &done));
+				else
+					done.release(); //empty chunk
+				begin = end;
+			}
+			//the calling thread does the last chunk while waiting
+			localJob(begin, size);
+			done.acquire(chunkCount - 1);
+		}
+	}
+}
+
+template<typename T> bool Utils::StaticVectorParallel::fill(Utils::StaticVector<T>& vector, const T& value, QThreadPool* pool)
+{
+	if (!vector.isWritable())
+		return false;
+	const Utils::StaticVectorKernels::FillJob<T> job = { vector.data(), value };
+	Utils::StaticVectorKernels::runParallel(vector.data(), vector.size(), job, pool);
+	return true;
+}
+
+template<typename T, typename Generator> bool Utils::StaticVectorParallel::generate(Utils::StaticVector<T>& vector, Generator generator, QThreadPool* pool)
+{
+	if (!vector.isWritable())
+		return false;
+	const Utils::StaticVectorKernels::GenerateJob<T, Generator> job = { vector.data(), generator };
+	Utils::StaticVectorKernels::runParallel(vector.data(), vector.size(), job, pool);
+	return true;
+}
+
+template<typename T, typename U, typename Function> bool Utils::StaticVectorParallel::transform(Utils::StaticVector<T>& vector, const Utils::StaticVector<U>& source, Function function, QThreadPool* pool)
+{
+	if (!vector.isWritable() || vector.size() != source.size())
+		return false;
+	const Utils::StaticVectorKernels::TransformJob<T, U, Function> job = { vector.data(), source.data(), function };
+	Utils::StaticVectorKernels::runParallel(vector.data(), vector.size(), job, pool);
+	return true;
+}
+
+#endif //UTILS_STATICVECTORPARALLEL_H
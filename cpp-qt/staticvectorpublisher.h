@@ -0,0 +1,154 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+#ifndef UTILS_STATICVECTORPUBLISHER_H
+#define UTILS_STATICVECTORPUBLISHER_H
+
+#include "staticvector.h"
+
+#include <QtCore/QThread>
+
+namespace Utils
+{
+	/**
+	 * \class StaticVectorPublisher
+	 *
+	 * This class lets one writer thread publish consecutive versions of a StaticVector, while any number of reader threads take consistent snapshots of the most recently published version, without any locks:
+\code
+//writer thread
+Utils::StaticVector<float>& buffer = publisher.beginWrite(sampleCount);
+fillSamples(buffer.data(), buffer.size());
+publisher.publish();
+
+//reader threads
+Utils::StaticVector<float> samples = publisher.snapshot();
+analyze(samples.data(), samples.size());
+\endcode
+	 * Internally, the publisher keeps \a SlotCount buffers (three by default, i.e. triple buffering): the published one, and back buffers for the writer. A snapshot is a read-only copy of the published buffer, so it keeps this version alive (and at the same address) for as long as the reader needs it, even if the writer has published several newer versions in the meantime. The memory of each version is freed when its last snapshot is dropped. If no snapshot holds it anymore, the memory of an old version is reused by beginWrite().
+	 *
+	 * snapshot() is lock-free: It only needs to retry if a new version is published while it runs. The writer only waits (in beginWrite()) if all back buffers are being copied by readers at this very moment, which is limited to a few instructions per reader.
+	 *
+	 * \note beginWrite() and publish() may only be called from one thread at a time. snapshot() and version() may be called from any thread.
+	 */
+	template<typename T, int SlotCount = 3> class StaticVectorPublisher
+	{
+		public:
+			///Creates a publisher that has not published anything yet.
+			inline StaticVectorPublisher();
+
+			///Returns a back buffer with \a size elements that can be filled by the writer. It will be visible to readers after publish() has been called. Until then, the same buffer is returned by every call to this method (but is resized if necessary).
+			///\warning The elements of the buffer are not initialized. If the buffer's memory is reused from an old version, it contains the values of that version.
+			inline Utils::StaticVector<T>& beginWrite(int size);
+			///Publishes the buffer returned by the last beginWrite() call as a new version.
+			inline void publish();
+
+			///Returns a read-only copy of the most recently published buffer, or an empty vector if nothing has been published yet. If \a version is given, the version number of the snapshot is written to it.
+			inline Utils::StaticVector<T> snapshot(int* version = 0) const;
+			///Returns the number of versions published so far.
+			inline int version() const;
+		private:
+			Q_DISABLE_COPY(StaticVectorPublisher)
+
+			Utils::StaticVector<T> m_slots[SlotCount];
+			int m_slotVersions[SlotCount];
+			//NOTE: The atomics are mutable because fetchAndAddOrdered(0) is used as an atomic load (which works with the QAtomicInt API of both Qt 4 and Qt 5).
+			mutable QAtomicInt m_slotPins[SlotCount]; //number of readers currently copying each slot
+			mutable QAtomicInt m_currentSlot; //index of the published slot, or -1
+			mutable QAtomicInt m_version;
+			int m_writeSlot; //index of the slot returned by beginWrite(), or -1
+	};
+}
+
+template<typename T, int SlotCount> Utils::StaticVectorPublisher<T, SlotCount>::StaticVectorPublisher()
+	: m_currentSlot(-1)
+	, m_version(0)
+	, m_writeSlot(-1)
+{
+	for (int i = 0; i < SlotCount; ++i)
+		m_slotVersions[i] = 0;
+}
+
+template<typename T, int SlotCount> Utils::StaticVector<T>& Utils::StaticVectorPublisher<T, SlotCount>::beginWrite(int size)
+{
+	while (m_writeSlot == -1)
+	{
+		//find a slot that is neither published nor currently being copied by a reader
+		//NOTE: A reader that pins a slot after this check will see that the slot is not published anymore, and back off without touching it.
+		const int currentSlot = m_currentSlot.fetchAndAddOrdered(0);
+		for (int i = 0; i < SlotCount; ++i)
+		{
+			if (i != currentSlot && m_slotPins[i].fetchAndAddOrdered(0) == 0)
+			{
+				m_writeSlot = i;
+				break;
+			}
+		}
+		if (m_writeSlot == -1)
+			QThread::yieldCurrentThread();
+	}
+	Utils::StaticVector<T>& buffer = m_slots[m_writeSlot];
+	//reuse the memory of the old version if no snapshot holds it anymore
+	if (buffer.size() != size || buffer.isShared() || !buffer.isWritable())
+		buffer.resize(size);
+	return buffer;
+}
+
+template<typename T, int SlotCount> void Utils::StaticVectorPublisher<T, SlotCount>::publish()
+{
+	Q_ASSERT(m_writeSlot != -1);
+	m_slotVersions[m_writeSlot] = m_version.fetchAndAddOrdered(1) + 1;
+	//this is a full memory barrier, so the buffer contents are visible to every reader that sees the new slot index
+	m_currentSlot.fetchAndStoreOrdered(m_writeSlot);
+	m_writeSlot = -1;
+}
+
+template<typename T, int SlotCount> Utils::StaticVector<T> Utils::StaticVectorPublisher<T, SlotCount>::snapshot(int* version) const
+{
+	while (true)
+	{
+		const int slot = m_currentSlot.fetchAndAddOrdered(0);
+		if (slot == -1)
+		{
+			if (version)
+				*version = 0;
+			return Utils::StaticVector<T>();
+		}
+		//pin the slot, then verify that it is still published (otherwise the writer might already be reusing it)
+		m_slotPins[slot].ref();
+		if (m_currentSlot.fetchAndAddOrdered(0) == slot)
+		{
+			Utils::StaticVector<T> result(m_slots[slot]);
+			if (version)
+				*version = m_slotVersions[slot];
+			m_slotPins[slot].deref();
+			return result;
+		}
+		m_slotPins[slot].deref();
+	}
+}
+
+template<typename T, int SlotCount> int Utils::StaticVectorPublisher<T, SlotCount>::version() const
+{
+	return m_version.fetchAndAddOrdered(0);
+}
+
+#endif //UTILS_STATICVECTORPUBLISHER_H
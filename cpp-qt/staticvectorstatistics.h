@@ -0,0 +1,171 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+#ifndef UTILS_STATICVECTORSTATISTICS_H
+#define UTILS_STATICVECTORSTATISTICS_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+
+namespace Utils
+{
+	/**
+	 * \class StaticVectorStatistics
+	 *
+	 * Memory statistics for all StaticVector data in this process, grouped by element type. They are only collected if UTILS_STATICVECTOR_STATISTICS is defined when staticvector.h is included (in all translation units, preferably through the build system), because bookkeeping costs a mutex lock per allocation and deallocation.
+	 *
+	 * The statistics are most useful to find data that is kept alive by forgotten read-only copies: Such data is counted in TypeStatistics::orphanedBuffers.
+\code
+Utils::StaticVectorStatistics::dump(); //prints something like:
+//StaticVector<f>: 12 buffers (2 orphaned), 48000 bytes (peak 96000 bytes, 57 allocations), reference counts: 1x8 2x3 5x1
+\endcode
+	 */
+	class StaticVectorStatistics
+	{
+		public:
+			struct TypeStatistics
+			{
+				QByteArray typeName; //as reported by typeid(T).name()
+				qint64 liveBytes; //bytes occupied by the elements of all live buffers
+				qint64 peakBytes; //maximum of liveBytes so far
+				qint64 allocationCount; //number of buffers created so far
+				int liveBuffers;
+				int orphanedBuffers; //live buffers which are only referenced by read-only copies (i.e., their writer has dropped them)
+				QMap<int, int> referenceCounts; //maps reference counts to the number of live buffers with this reference count
+
+				TypeStatistics() : liveBytes(0), peakBytes(0), allocationCount(0), liveBuffers(0), orphanedBuffers(0) {}
+			};
+
+			///Returns the current statistics for all element types that have been used in StaticVectors so far.
+			static inline QList<TypeStatistics> statistics();
+			///Writes the current statistics to qDebug().
+			static inline void dump();
+
+			//The following interface is used by StaticVector.
+			///Reports the reference count of the buffer \a data, and whether it is orphaned.
+			typedef void (*Inspector)(const void* data, int* refCount, bool* orphaned);
+			static inline void registerBuffer(const void* data, const char* typeName, qint64 bytes, Inspector inspector);
+			static inline void resizeBuffer(const void* data, qint64 bytes);
+			static inline void unregisterBuffer(const void* data);
+		private:
+			struct Buffer
+			{
+				QByteArray typeName;
+				qint64 bytes;
+				Inspector inspector;
+			};
+			struct Registry
+			{
+				QMutex mutex;
+				QHash<const void*, Buffer> buffers;
+				QMap<QByteArray, TypeStatistics> types; //only the counters are maintained here; the buffer counts are computed in statistics()
+			};
+			static inline Registry& registry();
+			static inline void addBytes(Registry& r, const QByteArray& typeName, qint64 bytes);
+	};
+}
+
+Utils::StaticVectorStatistics::Registry& Utils::StaticVectorStatistics::registry()
+{
+	static Registry r;
+	return r;
+}
+
+void Utils::StaticVectorStatistics::addBytes(Registry& r, const QByteArray& typeName, qint64 bytes)
+{
+	TypeStatistics& type = r.types[typeName];
+	type.liveBytes += bytes;
+	type.peakBytes = qMax(type.peakBytes, type.liveBytes);
+}
+
+void Utils::StaticVectorStatistics::registerBuffer(const void* data, const char* typeName, qint64 bytes, Inspector inspector)
+{
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+	const Buffer buffer = { QByteArray(typeName), bytes, inspector };
+	r.buffers.insert(data, buffer);
+	TypeStatistics& type = r.types[buffer.typeName];
+	type.typeName = buffer.typeName;
+	++type.allocationCount;
+	addBytes(r, buffer.typeName, bytes);
+}
+
+void Utils::StaticVectorStatistics::resizeBuffer(const void* data, qint64 bytes)
+{
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+	QHash<const void*, Buffer>::iterator it = r.buffers.find(data);
+	if (it == r.buffers.end())
+		return;
+	addBytes(r, it->typeName, bytes - it->bytes);
+	it->bytes = bytes;
+}
+
+void Utils::StaticVectorStatistics::unregisterBuffer(const void* data)
+{
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+	QHash<const void*, Buffer>::iterator it = r.buffers.find(data);
+	if (it == r.buffers.end())
+		return;
+	addBytes(r, it->typeName, -it->bytes);
+	r.buffers.erase(it);
+}
+
+QList<Utils::StaticVectorStatistics::TypeStatistics> Utils::StaticVectorStatistics::statistics()
+{
+	Registry& r = registry();
+	QMutexLocker locker(&r.mutex);
+	QMap<QByteArray, TypeStatistics> types = r.types;
+	//the buffers cannot be freed while we inspect them, because unregisterBuffer() needs the mutex
+	for (QHash<const void*, Buffer>::const_iterator it = r.buffers.constBegin(); it != r.buffers.constEnd(); ++it)
+	{
+		int refCount;
+		bool orphaned;
+		it->inspector(it.key(), &refCount, &orphaned);
+		TypeStatistics& type = types[it->typeName];
+		++type.liveBuffers;
+		if (orphaned)
+			++type.orphanedBuffers;
+		++type.referenceCounts[refCount];
+	}
+	return types.values();
+}
+
+void Utils::StaticVectorStatistics::dump()
+{
+	foreach (const TypeStatistics& type, statistics())
+	{
+		QString referenceCounts;
+		for (QMap<int, int>::const_iterator it = type.referenceCounts.constBegin(); it != type.referenceCounts.constEnd(); ++it)
+			referenceCounts += QString::fromLatin1(" %1x%2").arg(it.key()).arg(it.value());
+		qDebug() << QString::fromLatin1("StaticVector<%1>: %2 buffers (%3 orphaned), %4 bytes (peak %5 bytes, %6 allocations), reference counts:%7")
+			.arg(QString::fromLatin1(type.typeName)).arg(type.liveBuffers).arg(type.orphanedBuffers)
+			.arg(type.liveBytes).arg(type.peakBytes).arg(type.allocationCount).arg(referenceCounts);
+	}
+}
+
+#endif //UTILS_STATICVECTORSTATISTICS_H
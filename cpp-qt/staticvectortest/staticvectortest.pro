@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = staticvectortest
+CONFIG += console thread
+CONFIG -= app_bundle
+QT -= gui
+DEFINES += UTILS_STATICVECTOR_STATISTICS
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+
+# Input
+HEADERS += ../staticvector.h ../staticvectorstatistics.h ../staticvectoralgorithms.h ../compressedstaticvector.h
+SOURCES += testing.cpp
@@ -0,0 +1,342 @@
+/***************************************************************************
+ * Copyright 2009 Stefan Majewsky <majewsky@gmx.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ***************************************************************************/
+
+//Stress test for the sharing rules of Utils::StaticVector: Read-only copies are created, copied, sliced and destroyed concurrently in many threads, while the original instance drops the data. The data (and each element) has to be freed exactly once, by whichever thread drops the last reference. Additionally, all threads race for the write access after the writer has released it, and exactly one of them may win.
+//The buffers are big enough to be allocated with mmap() by glibc, so the number of mapped bytes shows whether they have been freed (and a second free() of such a buffer aborts the program).
+//Afterwards, the counters of Utils::StaticVectorStatistics are checked (this program is built with UTILS_STATICVECTOR_STATISTICS, see staticvectortest.pro), and Utils::CompressedStaticVector is checked with random data.
+
+#include "staticvector.h"
+#include "compressedstaticvector.h"
+#ifndef UTILS_STATICVECTOR_STATISTICS
+#	error This test needs UTILS_STATICVECTOR_STATISTICS.
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
+#include <QtCore/QThread>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+static qint64 mappedBytes()
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+	return mallinfo2().hblkhd;
+#else
+	return -1; //not available, so only crashes (or a leak checker) show errors
+#endif
+}
+
+static int load(QAtomicInt& counter)
+{
+	return counter.fetchAndAddOrdered(0);
+}
+
+static QAtomicInt constructedCount;
+static QAtomicInt destructedCount;
+
+struct Tracker //a complex type, so StaticVector constructs and destructs the elements
+{
+	int value;
+	Tracker() : value(42) { constructedCount.ref(); }
+	~Tracker() { destructedCount.ref(); }
+};
+
+class ReaderThread : public QThread
+{
+	public:
+		ReaderThread(const Utils::StaticVector<Tracker>& vector, QAtomicInt* start, QAtomicInt* attempts, QAtomicInt* winners, int threadCount)
+			: m_vector(vector), m_start(start), m_attempts(attempts), m_winners(winners), m_threadCount(threadCount), m_errors(0) {}
+		int errors() const { return m_errors; }
+	protected:
+		virtual void run()
+		{
+			while (load(*m_start) == 0)
+				QThread::yieldCurrentThread();
+			for (int i = 0; i < Iterations; ++i)
+			{
+				Utils::StaticVector<Tracker> copy(m_vector);
+				Utils::StaticVector<Tracker> assigned;
+				assigned = copy;
+				const Utils::StaticVectorSlice<Tracker> slice = assigned.mid(1, 3);
+				if (copy.data() != m_vector.data() || copy.isWritable() || assigned.isWritable() || slice.at(0).value != 42 || assigned.at(assigned.size() - 1).value != 42)
+					++m_errors;
+			}
+			//race for the write access (the writer has released it before the threads were started)
+			if (m_vector.takeWriteAccess())
+				m_winners->ref();
+			//the winner has to keep the write access until all threads have tried
+			m_attempts->ref();
+			while (load(*m_attempts) < m_threadCount)
+				QThread::yieldCurrentThread();
+			m_vector.clear();
+		}
+	private:
+		enum { Iterations = 100000 };
+		Utils::StaticVector<Tracker> m_vector;
+		QAtomicInt* m_start;
+		QAtomicInt* m_attempts;
+		QAtomicInt* m_winners;
+		int m_threadCount;
+		int m_errors;
+};
+
+static int testSharing()
+{
+	enum { Rounds = 20, ThreadCount = 8, Size = 1 << 20 };
+	const qint64 baseline = mappedBytes();
+	int errors = 0;
+	for (int round = 0; round < Rounds; ++round)
+	{
+		QAtomicInt start(0), attempts(0), winners(0);
+		QList<ReaderThread*> threads;
+		{
+			Utils::StaticVector<Tracker> vector;
+			vector.resize(Size);
+			vector.releaseWriteAccess();
+			for (int i = 0; i < ThreadCount; ++i)
+				threads << new ReaderThread(vector, &start, &attempts, &winners, ThreadCount);
+			foreach (ReaderThread* thread, threads)
+				thread->start();
+			start.fetchAndStoreOrdered(1);
+			//the original instance drops its reference while the threads are running
+		}
+		foreach (ReaderThread* thread, threads)
+		{
+			thread->wait();
+			errors += thread->errors();
+			delete thread;
+		}
+		if (load(winners) != 1)
+		{
+			fprintf(stderr, "round %d: %d threads got write access (expected 1)\n", round, load(winners));
+			++errors;
+		}
+		if (load(constructedCount) != (round + 1) * Size || load(destructedCount) != load(constructedCount))
+		{
+			fprintf(stderr, "round %d: %d elements constructed, %d destructed\n", round, load(constructedCount), load(destructedCount));
+			++errors;
+		}
+		const qint64 leakedBytes = mappedBytes() - baseline;
+		if (leakedBytes != 0)
+		{
+			fprintf(stderr, "round %d: %lld bytes have not been freed\n", round, leakedBytes);
+			++errors;
+		}
+	}
+	return errors;
+}
+
+//BEGIN statistics
+
+struct StatisticsElement //only used in testStatistics(), so that no other buffers show up in its statistics
+{
+	qint64 value;
+};
+
+static Utils::StaticVectorStatistics::TypeStatistics statisticsFor(const char* typeName)
+{
+	foreach (const Utils::StaticVectorStatistics::TypeStatistics& type, Utils::StaticVectorStatistics::statistics())
+		if (type.typeName == typeName)
+			return type;
+	return Utils::StaticVectorStatistics::TypeStatistics();
+}
+
+static int checkStatistics(const char* step, int liveBuffers, int orphanedBuffers, qint64 liveBytes, qint64 peakBytes, qint64 allocationCount, int refCount)
+{
+	const Utils::StaticVectorStatistics::TypeStatistics type = statisticsFor(typeid(StatisticsElement).name());
+	//all buffers in this test have the same reference count
+	const bool refCountsMatch = liveBuffers == 0 ? type.referenceCounts.isEmpty() : (type.referenceCounts.size() == 1 && type.referenceCounts.value(refCount) == liveBuffers);
+	if (type.liveBuffers == liveBuffers && type.orphanedBuffers == orphanedBuffers && type.liveBytes == liveBytes
+		&& type.peakBytes == peakBytes && type.allocationCount == allocationCount && refCountsMatch)
+		return 0;
+	fprintf(stderr, "statistics after %s: %d buffers (%d orphaned), %lld bytes (peak %lld bytes, %lld allocations), reference counts do%s match (expected %d buffers (%d orphaned), %lld bytes (peak %lld bytes, %lld allocations) with reference count %d)\n",
+		step, type.liveBuffers, type.orphanedBuffers, type.liveBytes, type.peakBytes, type.allocationCount, refCountsMatch ? "" : " not",
+		liveBuffers, orphanedBuffers, liveBytes, peakBytes, allocationCount, refCount);
+	return 1;
+}
+
+static int testStatistics()
+{
+	enum { Size = 1000, Bytes = Size * sizeof(StatisticsElement), Capacity = 1 << 20 };
+	int errors = checkStatistics("start", 0, 0, 0, 0, 0, 0);
+	{
+		Utils::StaticVector<StatisticsElement> vector;
+		vector.resize(Size);
+		errors += checkStatistics("resize", 1, 0, Bytes, Bytes, 1, 1);
+		{
+			const Utils::StaticVector<StatisticsElement> copy(vector);
+			errors += checkStatistics("copy", 1, 0, Bytes, Bytes, 1, 2);
+			//the writer drops the data, so only the read-only copy keeps it alive
+			vector.clear();
+			errors += checkStatistics("clear of the writer", 1, 1, Bytes, Bytes, 1, 1);
+			vector.resize(2 * Size);
+			errors += checkStatistics("second resize", 2, 1, 3 * Bytes, 3 * Bytes, 2, 1);
+		}
+		errors += checkStatistics("destruction of the copy", 1, 0, 2 * Bytes, 3 * Bytes, 2, 1);
+		vector.resize(Size);
+		errors += checkStatistics("third resize", 1, 0, Bytes, 3 * Bytes, 3, 1);
+	}
+	errors += checkStatistics("destruction", 0, 0, 0, 3 * Bytes, 3, 0);
+#ifdef Q_OS_UNIX
+	{
+		//grow() changes the size of a live buffer
+		Utils::StaticVector<StatisticsElement> vector;
+		if (vector.reserve(Capacity))
+		{
+			errors += checkStatistics("reserve", 1, 0, 0, 3 * Bytes, 4, 1);
+			vector.grow(4 * Size);
+			errors += checkStatistics("grow", 1, 0, 4 * Bytes, 4 * Bytes, 4, 1);
+		}
+		else
+		{
+			fprintf(stderr, "reserve(%d) failed\n", int(Capacity));
+			++errors;
+		}
+	}
+	errors += checkStatistics("destruction of the reserved vector", 0, 0, 0, 4 * Bytes, 4, 0);
+#endif
+	return errors;
+}
+
+//END statistics
+
+//BEGIN compression
+
+static quint32 randomNumber(quint32& state) //xorshift, so that failures can be reproduced on all platforms
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+//Fills one block with random values whose range needs exactly \a bits bits (so that the bit width chosen by compress() is known).
+static void fillBlock(int* values, int size, int bits, quint32& state)
+{
+	const quint32 range = bits == 0 ? 0 : (bits == 32 ? ~quint32(0) : (quint32(1) << bits) - 1);
+	const int reference = int(quint32(INT_MIN) + (range == ~quint32(0) ? 0 : randomNumber(state) % (~quint32(0) - range)));
+	for (int i = 0; i < size; ++i)
+		values[i] = int(quint32(reference) + (range == 0 ? 0 : randomNumber(state) & range));
+	//make sure that both ends of the range occur
+	values[randomNumber(state) % size] = reference;
+	int maximumIndex = randomNumber(state) % size;
+	if (size > 1 && values[maximumIndex] == reference)
+		maximumIndex = (maximumIndex + 1) % size;
+	values[maximumIndex] = int(quint32(reference) + range);
+}
+
+static int checkRoundtrip(const char* name, const int* values, int size)
+{
+	typedef Utils::CompressedStaticVector Compressed;
+	Compressed compressed;
+	compressed.compress(values, size);
+	int errors = 0;
+	if (compressed.size() != size || compressed.blockCount() != (size + Compressed::BlockSize - 1) / Compressed::BlockSize)
+	{
+		fprintf(stderr, "%s: size %d with %d blocks (expected %d values)\n", name, compressed.size(), compressed.blockCount(), size);
+		return 1;
+	}
+	for (int i = 0; i < size; ++i)
+		if (compressed.at(i) != values[i])
+		{
+			fprintf(stderr, "%s: at(%d) = %d (expected %d)\n", name, i, compressed.at(i), values[i]);
+			++errors;
+			break;
+		}
+	if (compressed.value(-1, 23) != 23 || compressed.value(size, 23) != 23)
+	{
+		fprintf(stderr, "%s: value() does not return the default value for invalid indexes\n", name);
+		++errors;
+	}
+	int block[Compressed::BlockSize];
+	for (int b = 0; b < compressed.blockCount(); ++b)
+	{
+		compressed.decodeBlock(b, block);
+		const int blockSize = qMin(int(Compressed::BlockSize), size - b * Compressed::BlockSize);
+		if (memcmp(block, values + b * Compressed::BlockSize, blockSize * sizeof(int)) != 0)
+		{
+			fprintf(stderr, "%s: decodeBlock(%d) does not match\n", name, b);
+			++errors;
+			break;
+		}
+	}
+	Utils::StaticVector<int> decompressed;
+	compressed.decompress(decompressed);
+	if (decompressed.size() != size || (size > 0 && memcmp(decompressed.data(), values, size * sizeof(int)) != 0))
+	{
+		fprintf(stderr, "%s: decompress() does not match\n", name);
+		++errors;
+	}
+	return errors;
+}
+
+static int testCompression()
+{
+	enum { BlockSize = Utils::CompressedStaticVector::BlockSize, MaxBits = 32, Rounds = 20 };
+	quint32 state = 0x2545F491;
+	int errors = 0;
+	char name[64];
+	//blocks of each bit width on their own, also as a partial block
+	int values[BlockSize];
+	for (int bits = 0; bits <= MaxBits; ++bits)
+	{
+		fillBlock(values, BlockSize, bits, state);
+		snprintf(name, sizeof(name), "full block with %d bits", bits);
+		errors += checkRoundtrip(name, values, BlockSize);
+		const int partialSize = 1 + randomNumber(state) % (BlockSize - 1);
+		fillBlock(values, partialSize, bits, state);
+		snprintf(name, sizeof(name), "block of %d values with %d bits", partialSize, bits);
+		errors += checkRoundtrip(name, values, partialSize);
+	}
+	//vectors with random bit widths in each block, and a partial last block
+	Utils::StaticVector<int> data;
+	for (int round = 0; round < Rounds; ++round)
+	{
+		const int blockCount = 1 + randomNumber(state) % 64;
+		const int size = (blockCount - 1) * BlockSize + 1 + randomNumber(state) % BlockSize;
+		data.resize(size);
+		for (int block = 0; block < blockCount; ++block)
+			fillBlock(data.data() + block * BlockSize, qMin(int(BlockSize), size - block * BlockSize), randomNumber(state) % (MaxBits + 1), state);
+		snprintf(name, sizeof(name), "round %d (%d values)", round, size);
+		errors += checkRoundtrip(name, data.data(), size);
+	}
+	errors += checkRoundtrip("empty vector", 0, 0);
+	return errors;
+}
+
+//END compression
+
+int main()
+{
+#ifdef __GLIBC__
+	mallopt(M_MMAP_THRESHOLD, 128 * 1024); //also disables the dynamic threshold, which would move freed buffer sizes to the heap
+#endif
+	int errors = testSharing();
+	errors += testStatistics();
+	errors += testCompression();
+	printf(errors ? "FAIL\n" : "PASS\n");
+	return errors ? 1 : 0;
+}